@@ -0,0 +1,41 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#include "aligned_buffer.h"
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace sift
+{
+
+void* alignedAllocate(size_t bytes, size_t alignment)
+{
+#ifdef _WIN32
+    void* ptr = _aligned_malloc(bytes, alignment);
+#else
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, bytes) != 0) {
+        ptr = nullptr;
+    }
+#endif
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void alignedFree(void* ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+}
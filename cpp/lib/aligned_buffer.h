@@ -0,0 +1,176 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <new>
+
+namespace sift
+{
+
+/*! Allocates memory whose address is a multiple of 'alignment'.
+ *  @param[in] bytes The number of bytes to allocate.
+ *  @param[in] alignment The alignment in bytes. Must be a power of two and a multiple of sizeof(void*).
+ *  @return Pointer to the allocated memory. Throws std::bad_alloc on failure.
+ */
+void* alignedAllocate(size_t bytes, size_t alignment);
+
+/*! Frees memory that was allocated with alignedAllocate.
+ *  @param[in] ptr Pointer returned by alignedAllocate or nullptr.
+ */
+void alignedFree(void* ptr);
+
+/*! \brief A resizable array whose first element is aligned to a cache line.
+ *
+ *  Unlike std::vector, resizing does not preserve the contents. Like std::vector, the memory is
+ *  kept when the buffer shrinks and reused when it grows again within its capacity.
+ */
+template <typename T>
+class AlignedBuffer
+{
+public:
+    /*! The alignment of the first element in bytes.
+     */
+    static const size_t kAlignment = 64;
+
+    /*! Creates an empty buffer.
+     */
+    AlignedBuffer():
+        _data(nullptr), _size(0), _capacity(0)
+    {}
+
+    /*! Allocates a buffer of value-initialized elements.
+     *  @param[in] size Number of elements.
+     */
+    explicit AlignedBuffer(size_t size):
+        _data(nullptr), _size(0), _capacity(0)
+    {
+        resize(size);
+    }
+
+    AlignedBuffer(const AlignedBuffer& other):
+        _data(nullptr), _size(0), _capacity(0)
+    {
+        resizeUninitialized(other._size);
+        std::copy(other._data, other._data + other._size, _data);
+    }
+
+    AlignedBuffer& operator=(const AlignedBuffer& other)
+    {
+        if (this != &other) {
+            resizeUninitialized(other._size);
+            std::copy(other._data, other._data + other._size, _data);
+        }
+        return *this;
+    }
+
+    AlignedBuffer(AlignedBuffer&& other):
+        _data(other._data), _size(other._size), _capacity(other._capacity)
+    {
+        other._data = nullptr;
+        other._size = 0;
+        other._capacity = 0;
+    }
+
+    AlignedBuffer& operator=(AlignedBuffer&& other)
+    {
+        if (this != &other) {
+            alignedFree(_data);
+            _data = other._data;
+            _size = other._size;
+            _capacity = other._capacity;
+            other._data = nullptr;
+            other._size = 0;
+            other._capacity = 0;
+        }
+        return *this;
+    }
+
+    ~AlignedBuffer()
+    {
+        alignedFree(_data);
+    }
+
+    /*! Changes the number of elements and value-initializes all of them. Nothing happens if the
+     *  size does not change, which keeps the contents.
+     *  @param[in] size Number of elements.
+     */
+    void resize(size_t size)
+    {
+        if (size == _size) {
+            return;
+        }
+
+        resizeUninitialized(size);
+        std::fill(_data, _data + size, T());
+    }
+
+    /*! Changes the number of elements without initializing them, for callers that are about to
+     *  overwrite every element anyway. Only allocates if the size exceeds the capacity.
+     *  @param[in] size Number of elements.
+     */
+    void resizeUninitialized(size_t size)
+    {
+        if (size > _capacity) {
+            if (size > std::numeric_limits<size_t>::max() / sizeof(T)) {
+                throw std::bad_alloc();
+            }
+
+            T* data = static_cast<T*>(alignedAllocate(size * sizeof(T), kAlignment));
+            alignedFree(_data);
+            _data = data;
+            _capacity = size;
+        }
+        _size = size;
+    }
+
+    /*! Frees the memory beyond the current size. The contents are kept.
+     */
+    void shrinkToFit()
+    {
+        if (_capacity == _size) {
+            return;
+        }
+
+        T* data = (_size > 0) ? static_cast<T*>(alignedAllocate(_size * sizeof(T), kAlignment)) : nullptr;
+        std::copy(_data, _data + _size, data);
+        alignedFree(_data);
+        _data = data;
+        _capacity = _size;
+    }
+
+    /*! Retrieves the number of elements.
+     *  @return Number of elements in the buffer.
+     */
+    size_t size() const { return _size; }
+
+    /*! Retrieves the number of elements the buffer can hold without allocating.
+     *  @return Number of allocated elements.
+     */
+    size_t capacity() const { return _capacity; }
+
+    /*! Retrieves the first element.
+     *  @return Pointer to the first element, nullptr if the buffer is empty.
+     */
+    T* data() { return _data; }
+
+    /*! Retrieves the first element.
+     *  @return Pointer to the first element, nullptr if the buffer is empty.
+     */
+    const T* data() const { return _data; }
+
+    T& operator[](size_t i) { return _data[i]; }
+    const T& operator[](size_t i) const { return _data[i]; }
+
+private:
+    T* _data;
+    size_t _size;
+    size_t _capacity;
+};
+
+}
@@ -0,0 +1,347 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#include "convolution.h"
+#include "kernels.h"
+#include "pixel_type.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+
+namespace sift
+{
+namespace detail
+{
+
+namespace
+{
+
+/*! Stores 'row' minus row 'y' of 'subtrahend' in row 'y' of 'difference' if 'difference' is not null.
+ */
+void subtractRow(const float* row, const float* subtrahend, float* difference, int y, size_t stride, size_t rowSize)
+{
+    if (difference != nullptr) {
+        getKernels().subtract(row, subtrahend + y * stride, difference + y * stride, rowSize);
+    }
+}
+
+}
+
+void convolveSpanScalar(const float* const* inputs, float* dst, size_t count, const float* taps, int radius)
+{
+    getScalarKernels()->convolveSpan(inputs, dst, count, taps, radius);
+}
+
+void convolveSpan(const float* const* inputs, float* dst, size_t count, const float* taps, int radius)
+{
+    getKernels().convolveSpan(inputs, dst, count, taps, radius);
+}
+
+void convolveSpanAndSubtract(const float* const* inputs, float* dst, const float* subtrahend, float* difference,
+                             size_t count, const float* taps, int radius)
+{
+    getKernels().convolveSpanAndSubtract(inputs, dst, subtrahend, difference, count, taps, radius);
+}
+
+ResampleTable computeUpsampleTable(int srcSize, const float* taps, int radius)
+{
+    assert(srcSize > 0);
+    const int dstSize = 2 * srcSize;
+
+    // Upsampled pixel j reads input j / 2 and its neighbor on the side of j, so the kernel around
+    // an output touches the inputs from (i - radius) / 2 - 1 to (i + radius) / 2 + 1.
+    ResampleTable table;
+    table.taps = std::min(radius + 3, srcSize);
+    table.first.resize(dstSize);
+    table.weights.assign(static_cast<size_t>(dstSize) * table.taps, 0.0f);
+    for (int i = 0; i < dstSize; ++i) {
+        const int lowest = (i - radius >= 0) ? (i - radius) / 2 - 1 : -1;
+        const int first = std::min(std::max(lowest, 0), srcSize - table.taps);
+        float* weights = table.weights.data() + static_cast<size_t>(i) * table.taps;
+        for (int k = -radius; k <= radius; ++k) {
+            const int j = std::min(std::max(i + k, 0), dstSize - 1);
+            const int x = j / 2;
+            const int neighbor = std::min(std::max((j % 2 == 0) ? x - 1 : x + 1, 0), srcSize - 1);
+            const float tap = taps[std::abs(k)];
+            weights[x - first] += 0.75f * tap;
+            weights[neighbor - first] += 0.25f * tap;
+        }
+        table.first[i] = first;
+    }
+    return table;
+}
+
+void expandResampleTable(const ResampleTable& table, int channels, std::vector<int>* offsets,
+                         std::vector<float>* weights)
+{
+    const size_t count = table.first.size() * channels;
+    offsets->resize(count);
+    weights->resize(count * table.taps);
+    for (size_t x = 0; x < table.first.size(); ++x) {
+        for (int c = 0; c < channels; ++c) {
+            const size_t i = x * channels + c;
+            (*offsets)[i] = table.first[x] * channels + c;
+            for (int k = 0; k < table.taps; ++k) {
+                (*weights)[k * count + i] = table.weights[x * table.taps + k];
+            }
+        }
+    }
+}
+
+void resampleSpan(const float* src, const int* offsets, const float* weights, int taps, int tapStride,
+                  float* dst, size_t count)
+{
+    getKernels().resampleSpan(src, offsets, weights, taps, tapStride, dst, count);
+}
+
+void weightedSumSpan(const float* const* inputs, const float* weights, int inputCount, float* dst, size_t count)
+{
+    getKernels().weightedSumSpan(inputs, weights, inputCount, dst, count);
+}
+
+namespace
+{
+
+/*! Shared implementation of the convolveHorizontal overloads. The border-padded copy of each row
+ *  is where pixels of other types than float are converted (see PixelTraits).
+ */
+template<typename T>
+void convolveHorizontalImpl(const T* src, size_t srcStride, float* dst, size_t dstStride,
+                            int width, int height, int channels, const float* taps, int radius, float* rowScratch)
+{
+    const size_t rowSize = static_cast<size_t>(width) * channels;
+    if (rowSize == 0) {
+        return;
+    }
+
+    // Each input of the span is the padded row shifted by one more pixel.
+    assert(radius <= kMaxSpanRadius);
+    const float* inputs[2 * kMaxSpanRadius + 1];
+    for (int k = 0; k <= 2 * radius; ++k) {
+        inputs[k] = rowScratch + static_cast<size_t>(k) * channels;
+    }
+
+    for (int y = 0; y < height; ++y) {
+        const T* srcRow = src + y * srcStride;
+
+        // Replicate the edge pixels into the border so that the span does not need to clamp.
+        for (int x = -radius; x < width + radius; ++x) {
+            const T* srcPixel = srcRow + static_cast<size_t>(std::min(std::max(x, 0), width - 1)) * channels;
+            std::transform(srcPixel, srcPixel + channels, rowScratch + static_cast<size_t>(x + radius) * channels,
+                           PixelTraits<T>::toFloat);
+        }
+
+        convolveSpan(inputs, dst + y * dstStride, rowSize, taps, radius);
+    }
+}
+
+}
+
+void convolveHorizontal(const float* src, size_t srcStride, float* dst, size_t dstStride,
+                        int width, int height, int channels, const float* taps, int radius, float* rowScratch)
+{
+    assert(src != dst);
+    convolveHorizontalImpl(src, srcStride, dst, dstStride, width, height, channels, taps, radius, rowScratch);
+}
+
+void convolveHorizontal(const half* src, size_t srcStride, float* dst, size_t dstStride,
+                        int width, int height, int channels, const float* taps, int radius, float* rowScratch)
+{
+    convolveHorizontalImpl(src, srcStride, dst, dstStride, width, height, channels, taps, radius, rowScratch);
+}
+
+void convolveHorizontal(const uint8_t* src, size_t srcStride, float* dst, size_t dstStride,
+                        int width, int height, int channels, const float* taps, int radius, float* rowScratch)
+{
+    convolveHorizontalImpl(src, srcStride, dst, dstStride, width, height, channels, taps, radius, rowScratch);
+}
+
+void convolveHorizontal(const uint16_t* src, size_t srcStride, float* dst, size_t dstStride,
+                        int width, int height, int channels, const float* taps, int radius, float* rowScratch)
+{
+    convolveHorizontalImpl(src, srcStride, dst, dstStride, width, height, channels, taps, radius, rowScratch);
+}
+
+void convolveHorizontalUnclamped(const float* src, size_t srcStride, float* dst, size_t dstStride,
+                                 int width, int height, int channels, const float* taps, int radius)
+{
+    assert(src != dst);
+    const size_t rowSize = static_cast<size_t>(width) * channels;
+    if (rowSize == 0) {
+        return;
+    }
+
+    assert(radius <= kMaxSpanRadius);
+    const float* inputs[2 * kMaxSpanRadius + 1];
+    for (int y = 0; y < height; ++y) {
+        const float* srcRow = src + y * srcStride;
+        for (int k = -radius; k <= radius; ++k) {
+            inputs[k + radius] = srcRow + static_cast<ptrdiff_t>(k) * channels;
+        }
+        convolveSpan(inputs, dst + y * dstStride, rowSize, taps, radius);
+    }
+}
+
+namespace
+{
+
+/*! Shared implementation of convolveVertical and convolveVerticalUnclamped.
+ */
+template<bool Clamp>
+void convolveVerticalImpl(const float* src, size_t srcStride, float* dst, size_t dstStride,
+                          int width, int height, int channels, const float* taps, int radius,
+                          const float* subtrahend, float* difference)
+{
+    assert(src != dst);
+    assert((subtrahend == nullptr) == (difference == nullptr));
+    const size_t rowSize = static_cast<size_t>(width) * channels;
+    if (rowSize == 0) {
+        return;
+    }
+
+    assert(radius <= kMaxSpanRadius);
+    const float* inputs[2 * kMaxSpanRadius + 1];
+    for (int y = 0; y < height; ++y) {
+        for (int k = -radius; k <= radius; ++k) {
+            const int row = Clamp ? std::min(std::max(y + k, 0), height - 1) : y + k;
+            inputs[k + radius] = src + static_cast<ptrdiff_t>(row) * static_cast<ptrdiff_t>(srcStride);
+        }
+
+        const size_t offset = y * dstStride;
+        if (difference != nullptr) {
+            convolveSpanAndSubtract(inputs, dst + offset, subtrahend + offset, difference + offset,
+                                    rowSize, taps, radius);
+        } else {
+            convolveSpan(inputs, dst + offset, rowSize, taps, radius);
+        }
+    }
+}
+
+}
+
+void convolveVertical(const float* src, size_t srcStride, float* dst, size_t dstStride,
+                      int width, int height, int channels, const float* taps, int radius,
+                      const float* subtrahend, float* difference)
+{
+    convolveVerticalImpl<true>(src, srcStride, dst, dstStride, width, height, channels, taps, radius,
+                               subtrahend, difference);
+}
+
+void convolveVerticalUnclamped(const float* src, size_t srcStride, float* dst, size_t dstStride,
+                               int width, int height, int channels, const float* taps, int radius,
+                               const float* subtrahend, float* difference)
+{
+    convolveVerticalImpl<false>(src, srcStride, dst, dstStride, width, height, channels, taps, radius,
+                                subtrahend, difference);
+}
+
+void recursiveGaussianHorizontal(const float* src, size_t srcStride, float* dst, size_t dstStride,
+                                 int width, int height, int channels,
+                                 const float* coefficients, const float* boundary, float* rowScratch)
+{
+    const size_t rowSize = static_cast<size_t>(width) * channels;
+    if (rowSize == 0) {
+        return;
+    }
+
+    const float b = coefficients[0];
+    const float a1 = coefficients[1];
+    const float a2 = coefficients[2];
+    const float a3 = coefficients[3];
+    const size_t lastPixel = rowSize - channels;
+
+    for (int y = 0; y < height; ++y) {
+        const float* srcRow = src + y * srcStride;
+        float* dstRow = dst + y * dstStride;
+
+        for (int c = 0; c < channels; ++c) {
+            // The causal pass starts in the steady state of a constant signal, which is the edge value.
+            float w1 = srcRow[c];
+            float w2 = w1;
+            float w3 = w1;
+            for (size_t i = c; i < rowSize; i += channels) {
+                const float w = b * srcRow[i] + a1 * w1 + a2 * w2 + a3 * w3;
+                rowScratch[i] = w;
+                w3 = w2;
+                w2 = w1;
+                w1 = w;
+            }
+
+            const float edge = srcRow[lastPixel + c];
+            const float d1 = w1 - edge;
+            const float d2 = w2 - edge;
+            const float d3 = w3 - edge;
+            float y1 = edge + boundary[0] * d1 + boundary[1] * d2 + boundary[2] * d3;
+            float y2 = edge + boundary[3] * d1 + boundary[4] * d2 + boundary[5] * d3;
+            float y3 = edge + boundary[6] * d1 + boundary[7] * d2 + boundary[8] * d3;
+            dstRow[lastPixel + c] = y1;
+
+            for (size_t i = lastPixel + c; i >= static_cast<size_t>(channels); ) {
+                i -= channels;
+                const float yv = b * rowScratch[i] + a1 * y1 + a2 * y2 + a3 * y3;
+                dstRow[i] = yv;
+                y3 = y2;
+                y2 = y1;
+                y1 = yv;
+            }
+        }
+    }
+}
+
+void recursiveGaussianVertical(float* data, size_t stride, int width, int height, int channels,
+                               const float* coefficients, const float* boundary, float* rowScratch,
+                               const float* subtrahend, float* difference)
+{
+    assert((subtrahend == nullptr) == (difference == nullptr));
+    const size_t rowSize = static_cast<size_t>(width) * channels;
+    if (rowSize == 0 || height == 0) {
+        return;
+    }
+
+    const KernelTable& kernels = getKernels();
+
+    // The first and last input rows are overwritten before they are needed for the boundaries.
+    float* firstRow = rowScratch;
+    float* lastRow = rowScratch + rowSize;
+    float* beyondRow1 = rowScratch + 2 * rowSize;
+    float* beyondRow2 = rowScratch + 3 * rowSize;
+    std::copy(data, data + rowSize, firstRow);
+    std::copy(data + (height - 1) * stride, data + (height - 1) * stride + rowSize, lastRow);
+
+    // Rows are processed whole so that the inner loops run over contiguous memory and vectorize.
+    for (int y = 0; y < height; ++y) {
+        float* row = data + y * stride;
+        const float* w1 = (y >= 1) ? row - stride : firstRow;
+        const float* w2 = (y >= 2) ? row - 2 * stride : firstRow;
+        const float* w3 = (y >= 3) ? row - 3 * stride : firstRow;
+        kernels.recursiveFilterSpan(row, w1, w2, w3, row, rowSize, coefficients);
+    }
+
+    float* last = data + (height - 1) * stride;
+    const float* w2 = (height >= 2) ? last - stride : firstRow;
+    const float* w3 = (height >= 3) ? last - 2 * stride : firstRow;
+    for (size_t i = 0; i < rowSize; ++i) {
+        const float edge = lastRow[i];
+        const float d1 = last[i] - edge;
+        const float d2 = w2[i] - edge;
+        const float d3 = w3[i] - edge;
+        last[i] = edge + boundary[0] * d1 + boundary[1] * d2 + boundary[2] * d3;
+        beyondRow1[i] = edge + boundary[3] * d1 + boundary[4] * d2 + boundary[5] * d3;
+        beyondRow2[i] = edge + boundary[6] * d1 + boundary[7] * d2 + boundary[8] * d3;
+    }
+    subtractRow(last, subtrahend, difference, height - 1, stride, rowSize);
+
+    for (int y = height - 2; y >= 0; --y) {
+        float* row = data + y * stride;
+        const float* y1 = row + stride;
+        const float* y2 = (y + 2 < height) ? row + 2 * stride : beyondRow1;
+        const float* y3 = (y + 3 < height) ? row + 3 * stride : ((y + 3 == height) ? beyondRow1 : beyondRow2);
+        kernels.recursiveFilterSpan(row, y1, y2, y3, row, rowSize, coefficients);
+        subtractRow(row, subtrahend, difference, y, stride, rowSize);
+    }
+}
+
+}
+}
@@ -0,0 +1,212 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace sift
+{
+
+class half;
+
+namespace detail
+{
+
+/*! The largest kernel radius the convolution routines support.
+ */
+const int kMaxSpanRadius = 63;
+
+/*! Convolves a symmetric 1D kernel with 'count' consecutive floats.
+ *
+ *  The kernel is applied as dst[i] = sum_k taps[|k|] * inputs[radius + k][i] for k in [-radius, radius].
+ *  Passing row pointers for 'inputs' gives a vertical pass, passing pointers offset by one pixel
+ *  each into a border-padded row gives a horizontal pass.
+ *  @param[in] inputs 2 * radius + 1 input pointers. Each must be readable for 'count' floats.
+ *  @param[out] dst Output buffer. Must not alias any of the inputs.
+ *  @param[in] count Number of floats to produce.
+ *  @param[in] taps Half of the symmetric kernel. taps[0] is the center tap.
+ *  @param[in] radius Radius of the kernel. Must not be larger than kMaxSpanRadius.
+ */
+void convolveSpan(const float* const* inputs, float* dst, size_t count, const float* taps, int radius);
+
+/*! Same as convolveSpan but also stores dst[i] - subtrahend[i] in difference[i] in the same pass.
+ *  @param[in] subtrahend Values subtracted from the result. Must be readable for 'count' floats.
+ *  @param[out] difference Output buffer for the difference. Must not alias any of the inputs.
+ */
+void convolveSpanAndSubtract(const float* const* inputs, float* dst, const float* subtrahend, float* difference,
+                             size_t count, const float* taps, int radius);
+
+/*! Scalar implementation of convolveSpan that is compiled on every platform.
+ *  Used as the reference when validating the vectorized kernels.
+ */
+void convolveSpanScalar(const float* const* inputs, float* dst, size_t count, const float* taps, int radius);
+
+/*! Convolves every row of an interleaved image with a symmetric 1D kernel. Pixels
+ *  outside of the image are clamped to the closest edge pixel.
+ *  @param[in] src Source image data.
+ *  @param[in] srcStride Distance between the rows of 'src' in floats.
+ *  @param[out] dst Destination image data. Must not alias src.
+ *  @param[in] dstStride Distance between the rows of 'dst' in floats.
+ *  @param[in] width Width of the image in pixels.
+ *  @param[in] height Height of the image in pixels.
+ *  @param[in] channels Number of interleaved channels.
+ *  @param[in] taps Half of the symmetric kernel. taps[0] is the center tap.
+ *  @param[in] radius Radius of the kernel.
+ *  @param[in] rowScratch Scratch memory for one border-padded row. Must hold
+ *                        (width + 2 * radius) * channels floats.
+ */
+void convolveHorizontal(const float* src, size_t srcStride, float* dst, size_t dstStride,
+                        int width, int height, int channels, const float* taps, int radius, float* rowScratch);
+
+/*! Same as convolveHorizontal but reads pixels of another type, which are converted to float with
+ *  PixelTraits while each row is copied into 'rowScratch'. Lets the first filter of a pipeline read
+ *  decoded images directly instead of converting the whole image first.
+ */
+void convolveHorizontal(const half* src, size_t srcStride, float* dst, size_t dstStride,
+                        int width, int height, int channels, const float* taps, int radius, float* rowScratch);
+void convolveHorizontal(const uint8_t* src, size_t srcStride, float* dst, size_t dstStride,
+                        int width, int height, int channels, const float* taps, int radius, float* rowScratch);
+void convolveHorizontal(const uint16_t* src, size_t srcStride, float* dst, size_t dstStride,
+                        int width, int height, int channels, const float* taps, int radius, float* rowScratch);
+
+/*! Same as convolveHorizontal but the pixels outside of the image are read from 'src' instead of
+ *  being clamped, so the inner loop runs straight over the source rows.
+ *  @param[in] src Source image data. Every row must be readable for 'radius' pixels before its
+ *                 first and after its last pixel, e.g. because the image has a halo.
+ */
+void convolveHorizontalUnclamped(const float* src, size_t srcStride, float* dst, size_t dstStride,
+                                 int width, int height, int channels, const float* taps, int radius);
+
+/*! Convolves every column of an interleaved image with a symmetric 1D kernel. Pixels
+ *  outside of the image are clamped to the closest edge pixel.
+ *  @param[in] src Source image data.
+ *  @param[in] srcStride Distance between the rows of 'src' in floats.
+ *  @param[out] dst Destination image data. Must not alias src.
+ *  @param[in] dstStride Distance between the rows of 'dst' in floats.
+ *  @param[in] width Width of the image in pixels.
+ *  @param[in] height Height of the image in pixels.
+ *  @param[in] channels Number of interleaved channels.
+ *  @param[in] taps Half of the symmetric kernel. taps[0] is the center tap.
+ *  @param[in] radius Radius of the kernel.
+ *  @param[in] subtrahend If not null, an image laid out like 'dst' that is subtracted from the result.
+ *  @param[out] difference If not null, receives the result minus 'subtrahend' row by row while
+ *                         the result is still in cache. Laid out like 'dst'.
+ */
+void convolveVertical(const float* src, size_t srcStride, float* dst, size_t dstStride,
+                      int width, int height, int channels, const float* taps, int radius,
+                      const float* subtrahend = nullptr, float* difference = nullptr);
+
+/*! Same as convolveVertical but the rows outside of the image are read from 'src' instead of
+ *  being clamped.
+ *  @param[in] src Source image data. 'radius' rows above the first and below the last row
+ *                 must be readable.
+ */
+void convolveVerticalUnclamped(const float* src, size_t srcStride, float* dst, size_t dstStride,
+                               int width, int height, int channels, const float* taps, int radius,
+                               const float* subtrahend = nullptr, float* difference = nullptr);
+
+/*! Applies the recursive Gaussian of [Young and van Vliet 1995] along every row of an
+ *  interleaved image: a causal pass w[n] = B x[n] + a1 w[n - 1] + a2 w[n - 2] + a3 w[n - 3]
+ *  followed by the same recursion run backwards over w. Pixels outside of the image are
+ *  treated as copies of the closest edge pixel, which [Triggs and Sdika 2006] shows can be
+ *  handled exactly by initializing the anti-causal pass from the end of the causal pass.
+ *  @param[in] src Source image data.
+ *  @param[in] srcStride Distance between the rows of 'src' in floats.
+ *  @param[out] dst Destination image data. May alias src if the strides are the same.
+ *  @param[in] dstStride Distance between the rows of 'dst' in floats.
+ *  @param[in] width Width of the image in pixels.
+ *  @param[in] height Height of the image in pixels.
+ *  @param[in] channels Number of interleaved channels.
+ *  @param[in] coefficients B, a1, a2 and a3.
+ *  @param[in] boundary Row-major 3x3 matrix that maps the deviations of w[N - 1], w[N - 2] and
+ *                      w[N - 3] from the edge value to the deviations of the anti-causal
+ *                      outputs at N - 1, N and N + 1.
+ *  @param[in] rowScratch Scratch memory for one row. Must hold width * channels floats.
+ */
+void recursiveGaussianHorizontal(const float* src, size_t srcStride, float* dst, size_t dstStride,
+                                 int width, int height, int channels,
+                                 const float* coefficients, const float* boundary, float* rowScratch);
+
+/*! Applies the recursive Gaussian of [Young and van Vliet 1995] along every column of an
+ *  interleaved image. See recursiveGaussianHorizontal for the details.
+ *  @param[in,out] data Image data that is filtered in place.
+ *  @param[in] stride Distance between the rows of 'data' in floats.
+ *  @param[in] width Width of the image in pixels.
+ *  @param[in] height Height of the image in pixels.
+ *  @param[in] channels Number of interleaved channels.
+ *  @param[in] coefficients B, a1, a2 and a3.
+ *  @param[in] boundary Row-major 3x3 boundary matrix.
+ *  @param[in] rowScratch Scratch memory for four rows. Must hold 4 * width * channels floats.
+ *  @param[in] subtrahend If not null, an image laid out like 'data' that is subtracted from the result.
+ *                        Must not alias 'data'.
+ *  @param[out] difference If not null, receives the result minus 'subtrahend' as each row of the
+ *                         anti-causal pass is finished.
+ */
+void recursiveGaussianVertical(float* data, size_t stride, int width, int height, int channels,
+                               const float* coefficients, const float* boundary, float* rowScratch,
+                               const float* subtrahend = nullptr, float* difference = nullptr);
+
+/*! \brief The taps along one axis of a filter that also changes the size of the image, e.g. an
+ *  area resize or an upsampling followed by a blur.
+ *
+ *  Output i is the sum of weights[i * taps + k] times input first[i] + k over k < taps, so every
+ *  output reads 'taps' consecutive inputs. Inputs outside of the image are folded onto the edge.
+ */
+struct ResampleTable
+{
+    int taps;
+    std::vector<int> first;
+    std::vector<float> weights;
+};
+
+/*! Computes the table that upsamples by 2 with linear interpolation between the pixel centers and
+ *  then convolves with a symmetric kernel, both clamped at the edges. Upsampled pixel 2x is
+ *  0.75 * x + 0.25 * (x - 1) and pixel 2x + 1 is 0.75 * x + 0.25 * (x + 1), like resampleImage
+ *  with a factor of 0.5 and ResampleMode::Bilinear.
+ *  @param[in] srcSize Number of input pixels along the axis. There are twice as many outputs.
+ *  @param[in] taps Half of the symmetric kernel. taps[0] is the center tap.
+ *  @param[in] radius Radius of the kernel.
+ *  @return At most radius + 3 taps per output.
+ */
+ResampleTable computeUpsampleTable(int srcSize, const float* taps, int radius);
+
+/*! Expands the table of a horizontal pass to one entry per element of rows with 'channels'
+ *  interleaved channels, with the weights stored tap by tap as resampleSpan expects.
+ *  @param[in] table Table of whole pixels.
+ *  @param[in] channels Number of interleaved channels.
+ *  @param[out] offsets Receives the offset of the first input of every output element.
+ *  @param[out] weights Receives the weights of every output element, tap by tap.
+ */
+void expandResampleTable(const ResampleTable& table, int channels, std::vector<int>* offsets,
+                         std::vector<float>* weights);
+
+/*! Runs the horizontal pass of a resize on one row: dst[i] is the sum of weights[k * count + i] times
+ *  src[offsets[i] + k * tapStride] over k < taps. See expandResampleTable.
+ *  @param[in] src The input row.
+ *  @param[in] offsets Offset of the first input of every output element.
+ *  @param[in] weights Weights of every output element, tap by tap.
+ *  @param[in] taps Number of inputs per output.
+ *  @param[in] tapStride Distance between two inputs of an output, i.e. the number of channels.
+ *  @param[out] dst Output row. Must not alias 'src'.
+ *  @param[in] count Number of floats to produce.
+ */
+void resampleSpan(const float* src, const int* offsets, const float* weights, int taps, int tapStride,
+                  float* dst, size_t count);
+
+/*! Runs the vertical pass of a resize on one row: dst[i] is the sum of weights[k] * inputs[k][i]
+ *  over k < inputCount.
+ *  @param[in] inputs 'inputCount' input rows. Each must be readable for 'count' floats.
+ *  @param[in] weights Weight of every input row.
+ *  @param[in] inputCount Number of input rows.
+ *  @param[out] dst Output row. Must not alias any of the inputs.
+ *  @param[in] count Number of floats to produce.
+ */
+void weightedSumSpan(const float* const* inputs, const float* weights, int inputCount, float* dst, size_t count);
+
+}
+}
@@ -0,0 +1,133 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#include "cpu_features.h"
+#include <cassert>
+#include <cctype>
+#include <cstdlib>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace sift
+{
+
+namespace
+{
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+
+InstructionSet detectInstructionSet()
+{
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    const bool sse2 = (info[3] & (1 << 26)) != 0;
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+
+    bool avx2 = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+
+    // The OS has to save the upper halves of the YMM registers on context switches.
+    const bool ymmState = osxsave && (_xgetbv(0) & 0x6) == 0x6;
+    if (avx && avx2 && fma && ymmState) {
+        return InstructionSet::AVX2;
+    }
+    return sse2 ? InstructionSet::SSE2 : InstructionSet::Scalar;
+}
+
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+
+InstructionSet detectInstructionSet()
+{
+    // __builtin_cpu_supports also checks that the OS saves the AVX state.
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return InstructionSet::AVX2;
+    }
+    return __builtin_cpu_supports("sse2") ? InstructionSet::SSE2 : InstructionSet::Scalar;
+}
+
+#else
+
+InstructionSet detectInstructionSet()
+{
+    return InstructionSet::Scalar;
+}
+
+#endif
+
+InstructionSet selectInstructionSet()
+{
+    const InstructionSet supported = getSupportedInstructionSet();
+    const char* override = std::getenv("SIFT_ISA");
+    InstructionSet requested;
+    if (override == nullptr || !parseInstructionSet(override, &requested)) {
+        return supported;
+    }
+
+    // Never pick an instruction set that the CPU cannot run.
+    return (static_cast<int>(requested) < static_cast<int>(supported)) ? requested : supported;
+}
+
+}
+
+InstructionSet getSupportedInstructionSet()
+{
+    static const InstructionSet supported = detectInstructionSet();
+    return supported;
+}
+
+InstructionSet getActiveInstructionSet()
+{
+    static const InstructionSet active = selectInstructionSet();
+    return active;
+}
+
+const char* getInstructionSetName(InstructionSet instructionSet)
+{
+    switch (instructionSet) {
+    case InstructionSet::Scalar:
+        return "scalar";
+    case InstructionSet::SSE2:
+        return "sse2";
+    case InstructionSet::AVX2:
+        return "avx2";
+    }
+    assert(false);
+    return "";
+}
+
+bool parseInstructionSet(const char* name, InstructionSet* instructionSet)
+{
+    assert(name != nullptr);
+    assert(instructionSet != nullptr);
+
+    const InstructionSet candidates[] = { InstructionSet::Scalar, InstructionSet::SSE2, InstructionSet::AVX2 };
+    for (InstructionSet candidate : candidates) {
+        const char* candidateName = getInstructionSetName(candidate);
+        size_t i = 0;
+        while (name[i] != '\0' && std::tolower(static_cast<unsigned char>(name[i])) == candidateName[i]) {
+            ++i;
+        }
+
+        if (name[i] == '\0' && candidateName[i] == '\0') {
+            *instructionSet = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,47 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#pragma once
+
+namespace sift
+{
+
+/*! \brief The instruction sets that the hot loops of the library are compiled for.
+ *
+ *  Ordered so that every level is a superset of the ones before it.
+ */
+enum class InstructionSet
+{
+    Scalar = 0,
+    SSE2 = 1,
+    AVX2 = 2 // AVX2 and FMA.
+};
+
+/*! Queries the CPU (and, for AVX2, the OS) for the best instruction set it supports.
+ *  @return The best supported instruction set.
+ */
+InstructionSet getSupportedInstructionSet();
+
+/*! Retrieves the instruction set that the library uses. This is the best one the CPU supports
+ *  unless the SIFT_ISA environment variable is set to 'scalar', 'sse2' or 'avx2', in which case
+ *  that level is used if the CPU supports it. The choice is made once per process.
+ *  @return The instruction set that is in use.
+ */
+InstructionSet getActiveInstructionSet();
+
+/*! Retrieves the lowercase name of an instruction set, which is also what SIFT_ISA accepts.
+ *  @param[in] instructionSet The instruction set to name.
+ *  @return "scalar", "sse2" or "avx2".
+ */
+const char* getInstructionSetName(InstructionSet instructionSet);
+
+/*! Parses a name returned by getInstructionSetName. The comparison ignores case.
+ *  @param[in] name The name to parse.
+ *  @param[out] instructionSet Receives the instruction set if the name is valid.
+ *  @return True if the name is valid.
+ */
+bool parseInstructionSet(const char* name, InstructionSet* instructionSet);
+
+}
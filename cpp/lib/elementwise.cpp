@@ -0,0 +1,45 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#include "elementwise.h"
+#include "kernels.h"
+
+namespace sift
+{
+namespace detail
+{
+
+void addArrays(const float* lhs, const float* rhs, float* dst, size_t count)
+{
+    getKernels().add(lhs, rhs, dst, count);
+}
+
+void subtractArrays(const float* lhs, const float* rhs, float* dst, size_t count)
+{
+    getKernels().subtract(lhs, rhs, dst, count);
+}
+
+void negateArray(const float* src, float* dst, size_t count)
+{
+    getKernels().negate(src, dst, count);
+}
+
+void scaleArray(float scale, const float* src, float* dst, size_t count)
+{
+    getKernels().scale(scale, src, dst, count);
+}
+
+void axpbyArrays(float alpha, const float* x, float beta, const float* y, float* dst, size_t count)
+{
+    getKernels().axpby(alpha, x, beta, y, dst, count);
+}
+
+bool equalArrays(const float* lhs, const float* rhs, size_t count)
+{
+    return getKernels().equal(lhs, rhs, count);
+}
+
+}
+}
@@ -0,0 +1,46 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#pragma once
+
+#include <cstddef>
+
+namespace sift
+{
+namespace detail
+{
+
+/*! Element-wise operations on float arrays. They run the kernels of the instruction set
+ *  selected by getActiveInstructionSet (see kernels.h). Outputs may alias inputs as long as
+ *  they start at the same address.
+ */
+
+/*! dst[i] = lhs[i] + rhs[i]
+ */
+void addArrays(const float* lhs, const float* rhs, float* dst, size_t count);
+
+/*! dst[i] = lhs[i] - rhs[i]
+ */
+void subtractArrays(const float* lhs, const float* rhs, float* dst, size_t count);
+
+/*! dst[i] = -src[i]
+ */
+void negateArray(const float* src, float* dst, size_t count);
+
+/*! dst[i] = scale * src[i]
+ */
+void scaleArray(float scale, const float* src, float* dst, size_t count);
+
+/*! dst[i] = alpha * x[i] + beta * y[i]. With beta = 1 and dst = y this is the BLAS axpy.
+ */
+void axpbyArrays(float alpha, const float* x, float beta, const float* y, float* dst, size_t count);
+
+/*! Compares two arrays and stops at the first difference.
+ *  @return True if lhs[i] == rhs[i] for every i. NaNs are never equal and 0 equals -0.
+ */
+bool equalArrays(const float* lhs, const float* rhs, size_t count);
+
+}
+}
@@ -4,82 +4,844 @@
 // patented and its use for commercial applications must be licensed.
 // See the LICENSE file for details.
 #include "gaussian.h"
+#include "convolution.h"
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 namespace sift
 {
 
-Gaussian2D::Gaussian2D(const std::shared_ptr<Image>& img):
-    _filter(img)
-{}
+static_assert(kMaxGaussianRadius <= detail::kMaxSpanRadius, "Gaussians must fit the convolution routines.");
 
-Gaussian2D create2DGaussian(const float stddev)
+namespace
 {
-    std::shared_ptr<Image> filter(new Image);
 
-    Gaussian2D gaussian(filter);
+/*! Number of floats of row scratch memory convolveSeparable needs for an image of the given width.
+ */
+size_t getRowScratchSize(int width, int channels, int radius)
+{
+    return std::max(static_cast<size_t>(width + 2 * radius), 4 * static_cast<size_t>(width)) * channels;
+}
+
+/*! Returns the rows of an interleaved float image as they are.
+ */
+const float* getFloatRows(const float* src, size_t srcStride, float*, size_t, int, int, int, size_t* stride)
+{
+    *stride = srcStride;
+    return src;
+}
+
+/*! Converts the rows of an interleaved image of another pixel type to float into 'dst'.
+ *  @param[out] stride Receives the distance between the returned rows.
+ *  @return 'dst'.
+ */
+template<typename T>
+const float* getFloatRows(const T* src, size_t srcStride, float* dst, size_t dstStride, int width, int height,
+                          int channels, size_t* stride)
+{
+    const size_t rowSize = static_cast<size_t>(width) * channels;
+    for (int y = 0; y < height; ++y) {
+        const T* srcRow = src + y * srcStride;
+        std::transform(srcRow, srcRow + rowSize, dst + y * dstStride, PixelTraits<T>::toFloat);
+    }
+    *stride = dstStride;
+    return dst;
+}
+
+/*! Convolves 'src' with 'gaussian' and stores the result in 'dst', which may be the same as 'src'.
+ *  The FIR path runs the horizontal pass into 'tmp' and the vertical pass from 'tmp' into 'dst'.
+ *  The recursive path runs both passes in 'dst' and does not use 'tmp'. Rows of 'src' and 'dst'
+ *  are 'srcStride' and 'dstStride' elements apart, the rows of 'tmp' are packed. Pixels of other
+ *  types than float are converted by the horizontal FIR pass as it reads them, the recursive path
+ *  converts them into 'dst' first.
+ *  @param[in] tmp Temporary memory for width * height * channels floats.
+ *  @param[in] rowScratch Temporary memory for getRowScratchSize floats.
+ *  @param[out] difference If not null, receives 'dst' minus 'src' from the same pass that writes 'dst'.
+ *                         'dst' must not alias 'src' and must have the same stride in that case.
+ *                         Only supported for float sources.
+ */
+template<typename T>
+void convolveSeparable(const Gaussian2D& gaussian, const T* src, size_t srcStride, float* dst, size_t dstStride,
+                       int width, int height, int channels, float* tmp, float* rowScratch,
+                       float* difference = nullptr)
+{
+    assert(difference == nullptr || (std::is_same<T, float>::value && static_cast<const void*>(src) != dst &&
+                                     srcStride == dstStride));
+    const float* subtrahend = (difference != nullptr) ? reinterpret_cast<const float*>(src) : nullptr;
+    if (gaussian.getMode() == GaussianFilterMode::Recursive) {
+        size_t floatStride = 0;
+        const float* floatSrc = getFloatRows(src, srcStride, dst, dstStride, width, height, channels, &floatStride);
+        detail::recursiveGaussianHorizontal(floatSrc, floatStride, dst, dstStride, width, height, channels,
+                                            gaussian.getRecursiveCoefficients(), gaussian.getRecursiveBoundary(),
+                                            rowScratch);
+        detail::recursiveGaussianVertical(dst, dstStride, width, height, channels,
+                                          gaussian.getRecursiveCoefficients(), gaussian.getRecursiveBoundary(),
+                                          rowScratch, subtrahend, difference);
+        return;
+    }
+
+    const size_t tmpStride = static_cast<size_t>(width) * channels;
+    detail::convolveHorizontal(src, srcStride, tmp, tmpStride, width, height, channels,
+                               gaussian.getTaps(), gaussian.getRadius(), rowScratch);
+    detail::convolveVertical(tmp, tmpStride, dst, dstStride, width, height, channels,
+                             gaussian.getTaps(), gaussian.getRadius(), subtrahend, difference);
+}
+
+/*! Convolves 'src' with 'gaussian' and stores the result in 'dst', which may be the same view as 'src'.
+ *  Interleaved views are filtered in one go. The channels of views with a pixel stride of 1, such as
+ *  planar images, are filtered one at a time as single channel images. Anything else is filtered
+ *  in a packed copy.
+ */
+void convolveSeparable(const Gaussian2D& gaussian, const ConstImageView& src, const ImageView& dst)
+{
+    assert(src.getWidth() == dst.getWidth() && src.getHeight() == dst.getHeight() &&
+           src.getChannels() == dst.getChannels());
+    const int width = src.getWidth();
+    const int height = src.getHeight();
+    const int channels = src.getChannels();
+
+    // Both recursive passes can run in place so no temporary image is needed.
+    // Every temporary element is written before it is read so none of them are zero filled.
+    AlignedBuffer<float> tmp;
+    if (gaussian.getMode() == GaussianFilterMode::FIR) {
+        tmp.resizeUninitialized(static_cast<size_t>(width) * height * channels);
+    }
+    AlignedBuffer<float> rowScratch;
+    rowScratch.resizeUninitialized(getRowScratchSize(width, channels, gaussian.getRadius()));
+
+    if (src.isInterleaved() && dst.isInterleaved()) {
+        convolveSeparable(gaussian, src.getData(), src.getStride(), dst.getData(), dst.getStride(),
+                          width, height, channels, tmp.data(), rowScratch.data());
+    } else if (src.getPixelStride() == 1 && dst.getPixelStride() == 1) {
+        for (int c = 0; c < channels; ++c) {
+            convolveSeparable(gaussian, src.getRowPointer(0, c), src.getStride(), dst.getRowPointer(0, c),
+                              dst.getStride(), width, height, 1, tmp.data(), rowScratch.data());
+        }
+    } else {
+        Image packed(src);
+        convolveSeparable(gaussian, packed.getData(), packed.getStride(), packed.getData(), packed.getStride(),
+                          width, height, channels, tmp.data(), rowScratch.data());
+        copyImageView(packed, dst);
+    }
+}
+
+/*! Convolves 'src' with 'gaussian' and stores the result in 'dst', which may be the same image as 'src'.
+ *  A new destination gets the memory layout and the halo of the source. If the halo of 'src' is at
+ *  least as wide as the FIR kernel, both passes read it instead of clamping. The halo of 'dst' is
+ *  filled afterwards.
+ */
+void convolveSeparable(const Gaussian2D& gaussian, const Image& src, Image* dst)
+{
+    const int width = src.getWidth();
+    const int height = src.getHeight();
+    const int channels = src.getChannels();
+    if (dst->getWidth() != width || dst->getHeight() != height || dst->getChannels() != channels ||
+        dst->getPixelLayout() != src.getPixelLayout()) {
+        dst->setHalo(src.getHalo(), src.getBorderMode());
+        dst->resizeImageUninitialized(width, height, channels, src.getRowPadding(), src.getPixelLayout());
+    }
+
+    const int radius = gaussian.getRadius();
+    if (gaussian.getMode() == GaussianFilterMode::FIR && src.getHalo() >= radius) {
+        // The horizontal pass also filters the 'radius' halo rows above and below the image,
+        // which are then the rows the vertical pass reads past the edges.
+        const bool planar = src.getPixelLayout() == PixelLayout::Planar;
+        const int planes = planar ? channels : 1;
+        const int planeChannels = planar ? 1 : channels;
+        const size_t rowSize = static_cast<size_t>(width) * planeChannels;
+        AlignedBuffer<float> tmp;
+        tmp.resizeUninitialized(rowSize * (height + 2 * radius));
+        for (int p = 0; p < planes; ++p) {
+            detail::convolveHorizontalUnclamped(src.getRowPointer(-radius, p), src.getStride(), tmp.data(), rowSize,
+                                                width, height + 2 * radius, planeChannels,
+                                                gaussian.getTaps(), radius);
+            detail::convolveVerticalUnclamped(tmp.data() + radius * rowSize, rowSize, dst->getRowPointer(0, p),
+                                              dst->getStride(), width, height, planeChannels,
+                                              gaussian.getTaps(), radius);
+        }
+    } else {
+        convolveSeparable(gaussian, src.getView(), dst->getView());
+    }
+    dst->fillHalo();
+}
+
+/*! Convolves 'src' with 'gaussian' and keeps every other pixel of every other row
+ *  (starting from the first) like resampleImage(image, 2, 2) does. Only the columns
+ *  that are kept are filtered horizontally so the largest temporary is half the size of 'src'.
+ *  Pixels of other types than float are converted as each row is padded.
+ *  @param[in] tmp Temporary memory for (width / 2) * height * channels floats.
+ *  @param[out] dst Receives (width / 2) x (height / 2) pixels with rows 'dstStride' floats apart.
+ */
+template<typename T>
+void convolveAndDecimate(const Gaussian2D& gaussian, const T* src, size_t srcStride, float* dst, size_t dstStride,
+                         int width, int height, int channels, float* tmp)
+{
+    const int radius = gaussian.getRadius();
+    const float* taps = gaussian.getTaps();
+    const int newWidth = width / 2;
+    const int newHeight = height / 2;
+    const size_t rowSize = static_cast<size_t>(newWidth) * channels;
+
+    std::vector<float> paddedRow(static_cast<size_t>(width + 2 * radius) * channels);
+    for (int y = 0; y < height; ++y) {
+        const T* srcRow = src + static_cast<size_t>(y) * srcStride;
+        for (int x = -radius; x < width + radius; ++x) {
+            const T* srcPixel = srcRow + static_cast<size_t>(std::min(std::max(x, 0), width - 1)) * channels;
+            std::transform(srcPixel, srcPixel + channels, paddedRow.begin() + static_cast<size_t>(x + radius) * channels,
+                           PixelTraits<T>::toFloat);
+        }
+
+        float* tmpRow = tmp + static_cast<size_t>(y) * rowSize;
+        for (int x = 0; x < newWidth; ++x) {
+            const float* center = paddedRow.data() + static_cast<size_t>(2 * x + radius) * channels;
+            for (int c = 0; c < channels; ++c) {
+                float sum = taps[0] * center[c];
+                for (int k = 1; k <= radius; ++k) {
+                    sum += taps[k] * (center[c - k * channels] + center[c + k * channels]);
+                }
+                tmpRow[static_cast<size_t>(x) * channels + c] = sum;
+            }
+        }
+    }
+
+    // The vertical pass only has to produce the even rows.
+    std::vector<const float*> inputs(2 * radius + 1);
+    for (int y = 0; y < newHeight; ++y) {
+        for (int k = -radius; k <= radius; ++k) {
+            const int row = std::min(std::max(2 * y + k, 0), height - 1);
+            inputs[k + radius] = tmp + static_cast<size_t>(row) * rowSize;
+        }
+        detail::convolveSpan(inputs.data(), dst + static_cast<size_t>(y) * dstStride, rowSize, taps, radius);
+    }
+}
+
+/*! Convolves 'image' with 'gaussian' and keeps every other pixel of every other row.
+ *  @return The decimated image. It is interleaved if 'image' is and planar otherwise.
+ */
+template<typename T>
+Image convolveGaussian2DAndDecimate(const Gaussian2D& gaussian, const BasicImageView<T>& image)
+{
+    typedef typename std::remove_const<T>::type Pixel;
+    const int width = image.getWidth();
+    const int height = image.getHeight();
+    const int channels = image.getChannels();
+    AlignedBuffer<float> tmp;
+    tmp.resizeUninitialized(static_cast<size_t>(width / 2) * height * channels);
+
+    // Every pixel of the result is written by convolveAndDecimate.
+    Image retImage;
+    if (image.isInterleaved()) {
+        retImage.resizeImageUninitialized(width / 2, height / 2, channels);
+        convolveAndDecimate(gaussian, image.getData(), image.getStride(), retImage.getData(), retImage.getStride(),
+                            width, height, channels, tmp.data());
+        return retImage;
+    }
+
+    // Views whose channels are not planes are made planar first.
+    BasicImage<Pixel> planar;
+    if (image.getPixelStride() != 1) {
+        planar = BasicImage<Pixel>(image, RowPadding::None, PixelLayout::Planar);
+    }
+    const BasicImageView<const Pixel> src = (image.getPixelStride() == 1) ? image : planar.getView();
+
+    retImage.resizeImageUninitialized(width / 2, height / 2, channels, RowPadding::None, PixelLayout::Planar);
+    for (int c = 0; c < channels; ++c) {
+        convolveAndDecimate(gaussian, src.getRowPointer(0, c), src.getStride(), retImage.getRowPointer(0, c),
+                            retImage.getStride(), width, height, 1, tmp.data());
+    }
+    return retImage;
+}
+
+/*! Upsamples an interleaved float image by 2 and convolves it with a Gaussian in one pass per axis,
+ *  using tables from computeUpsampleTable that fold both together. The horizontal pass writes
+ *  2 * width x height pixels into 'tmp' and the vertical pass the 2 * width x 2 * height result
+ *  into 'dst', so the upsampled image is never stored before it is blurred.
+ *  @param[in] columnOffsets The column table expanded for the channels (see expandResampleTable).
+ *  @param[in] columnWeights The weights of the expanded column table.
+ */
+void upsampleAndConvolve(const float* src, size_t srcStride, int height, int channels,
+                         const std::vector<int>& columnOffsets, const std::vector<float>& columnWeights,
+                         int columnTaps, const detail::ResampleTable& rows, float* dst, float* tmp)
+{
+    const size_t rowSize = columnOffsets.size();
+    for (int y = 0; y < height; ++y) {
+        detail::resampleSpan(src + y * srcStride, columnOffsets.data(), columnWeights.data(), columnTaps, channels,
+                             tmp + y * rowSize, rowSize);
+    }
+
+    const float* inputs[kMaxGaussianRadius + 3];
+    assert(rows.taps <= kMaxGaussianRadius + 3);
+    for (int y = 0; y < 2 * height; ++y) {
+        for (int k = 0; k < rows.taps; ++k) {
+            inputs[k] = tmp + (rows.first[y] + k) * rowSize;
+        }
+        detail::weightedSumSpan(inputs, rows.weights.data() + static_cast<size_t>(y) * rows.taps, rows.taps,
+                                dst + y * rowSize, rowSize);
+    }
+}
+
+/*! Computes the size of an image along one axis in an octave, where octave -1 is upsampled.
+ */
+int getOctaveSize(int size, int octave)
+{
+    return (octave < 0) ? size << -octave : size >> octave;
+}
+
+/*! Where each part of a DoGScaleSpacePyramid lives in its arena. All offsets are in floats.
+ */
+struct PyramidLayout
+{
+    size_t gaussianOffsets[2];
+    size_t seedOffset;
+    size_t tmpOffset;
+    size_t rowScratchOffset;
+    size_t size;
+};
+
+/*! Rounds an offset into the arena up so that every image starts on a new cache line.
+ */
+size_t alignArenaOffset(size_t offset)
+{
+    const size_t alignment = AlignedBuffer<float>::kAlignment / sizeof(float);
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+/*! Computes the arena layout of a pyramid whose first octave has the given size.
+ *  @param[out] dogOffsets If not null, receives the offset of every DoG image.
+ */
+PyramidLayout computePyramidLayout(int width, int height, int channels, int octaves, int intervals,
+                                   std::vector<size_t>* dogOffsets)
+{
+    if (dogOffsets != nullptr) {
+        dogOffsets->clear();
+    }
+
+    size_t offset = 0;
+    for (int o = 0; o < octaves; ++o) {
+        const size_t levelSize = static_cast<size_t>(width >> o) * (height >> o) * channels;
+        for (int s = 0; s < intervals + 2; ++s) {
+            if (dogOffsets != nullptr) {
+                dogOffsets->push_back(offset);
+            }
+            offset = alignArenaOffset(offset + levelSize);
+        }
+    }
+
+    const size_t imageSize = static_cast<size_t>(width) * height * channels;
+    PyramidLayout layout;
+    for (int i = 0; i < 2; ++i) {
+        layout.gaussianOffsets[i] = offset;
+        offset = alignArenaOffset(offset + imageSize);
+    }
+    layout.seedOffset = offset;
+    offset = alignArenaOffset(offset + static_cast<size_t>(width / 2) * (height / 2) * channels);
+    layout.tmpOffset = offset;
+    offset = alignArenaOffset(offset + imageSize);
+    layout.rowScratchOffset = offset;
+    layout.size = offset + getRowScratchSize(width, channels, kMaxGaussianRadius);
+    return layout;
+}
+
+Gaussian2D computeGaussian(const float stddev, const float truncation)
+{
+    const int radius = static_cast<int>(std::ceil(truncation * stddev));
+    assert(radius <= kMaxGaussianRadius);
+
+    // Sample the Gaussian and normalize so that the taps sum to one, which
+    // keeps the overall brightness of the image unchanged.
+    double weights[kMaxGaussianRadius + 1];
+    weights[0] = 1.0;
+    double sum = 1.0;
+    const double denom = 2.0 * static_cast<double>(stddev) * stddev;
+    for (int k = 1; k <= radius; ++k) {
+        weights[k] = std::exp(-static_cast<double>(k) * k / denom);
+        sum += 2.0 * weights[k];
+    }
+
+    float taps[kMaxGaussianRadius + 1];
+    for (int k = 0; k <= radius; ++k) {
+        taps[k] = static_cast<float>(weights[k] / sum);
+    }
+    return Gaussian2D(taps, radius, stddev);
+}
+
+}
+
+Gaussian2D::Gaussian2D():
+    _radius(0), _stddev(0.0f), _mode(GaussianFilterMode::FIR)
+{
+    _taps[0] = 1.0f;
+}
+
+Gaussian2D::Gaussian2D(const float* taps, int radius, float stddev):
+    _radius(radius), _stddev(stddev), _mode(GaussianFilterMode::FIR)
+{
+    assert(taps != nullptr);
+    assert(radius >= 0 && radius <= kMaxGaussianRadius);
+    std::copy(taps, taps + radius + 1, _taps);
+}
+
+Gaussian2D::Gaussian2D(const float* coefficients, const float* boundary, float stddev):
+    _radius(0), _stddev(stddev), _mode(GaussianFilterMode::Recursive)
+{
+    assert(coefficients != nullptr);
+    assert(boundary != nullptr);
+    _taps[0] = 1.0f;
+    std::copy(coefficients, coefficients + 4, _recursiveCoefficients);
+    std::copy(boundary, boundary + 9, _recursiveBoundary);
+}
+
+GaussianKernelCache::GaussianKernelCache():
+    _kernels(new KernelMap)
+{
+}
+
+Gaussian2D GaussianKernelCache::get(float stddev, float truncation)
+{
+    if (!(stddev >= 0.0f) || !(truncation > 0.0f)) {
+        throw std::invalid_argument("Gaussian std dev must be non-negative and truncation must be positive.");
+    }
+
+    // Keeps the quantized keys well inside of the range of int64_t.
+    const float maxKeyValue = 1e6f;
+    if (std::ceil(truncation * stddev) > static_cast<float>(kMaxGaussianRadius) ||
+            stddev > maxKeyValue || truncation > maxKeyValue) {
+        throw std::invalid_argument("Gaussian std dev is too large for the maximum kernel radius.");
+    }
+
+    const Key key(std::llround(static_cast<double>(stddev) * kQuantization),
+                  std::llround(static_cast<double>(truncation) * kQuantization));
+
+    std::shared_ptr<const KernelMap> kernels = std::atomic_load(&_kernels);
+    KernelMap::const_iterator it = kernels->find(key);
+    if (it != kernels->end()) {
+        return it->second;
+    }
+
+    const float quantizedStddev = static_cast<float>(static_cast<double>(key.first) / kQuantization);
+    const float quantizedTruncation = static_cast<float>(static_cast<double>(key.second) / kQuantization);
+    if (std::ceil(quantizedTruncation * quantizedStddev) > static_cast<float>(kMaxGaussianRadius)) {
+        throw std::invalid_argument("Gaussian std dev is too large for the maximum kernel radius.");
+    }
+    const Gaussian2D gaussian = computeGaussian(quantizedStddev, quantizedTruncation);
+
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    kernels = std::atomic_load(&_kernels);
+    if (kernels->size() < kMaxEntries && kernels->find(key) == kernels->end()) {
+        std::shared_ptr<KernelMap> updatedKernels(new KernelMap(*kernels));
+        updatedKernels->insert(std::make_pair(key, gaussian));
+        std::atomic_store(&_kernels, std::shared_ptr<const KernelMap>(updatedKernels));
+    }
     return gaussian;
 }
 
+void GaussianKernelCache::precompute(int intervals, float stddev, float truncation)
+{
+    const std::vector<float> stddevs = computeIncrementalStddevs(intervals, stddev);
+    for (float incrementalStddev : stddevs) {
+        get(incrementalStddev, truncation);
+    }
+}
+
+size_t GaussianKernelCache::size() const
+{
+    return std::atomic_load(&_kernels)->size();
+}
+
+void GaussianKernelCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_writeMutex);
+    std::atomic_store(&_kernels, std::shared_ptr<const KernelMap>(new KernelMap));
+}
+
+GaussianKernelCache& GaussianKernelCache::global()
+{
+    static GaussianKernelCache cache;
+    return cache;
+}
+
+Gaussian2D create2DGaussian(const float stddev, const float truncation)
+{
+    return GaussianKernelCache::global().get(stddev, truncation);
+}
+
+Gaussian2D create2DRecursiveGaussian(const float stddev)
+{
+    if (!(stddev >= 0.0f) || !std::isfinite(stddev)) {
+        throw std::invalid_argument("Gaussian std dev must be non-negative and finite.");
+    }
+
+    if (stddev < 0.5f) {
+        return create2DGaussian(stddev);
+    }
+
+    // Equations 11b and 8c of [Young and van Vliet 1995].
+    const double sigma = stddev;
+    const double q = (sigma >= 2.5) ? 0.98711 * sigma - 0.96330 : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * sigma);
+    const double q2 = q * q;
+    const double q3 = q2 * q;
+    const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+    const double a1 = (2.44413 * q + 2.85619 * q2 + 1.26661 * q3) / b0;
+    const double a2 = -(1.4281 * q2 + 1.26661 * q3) / b0;
+    const double a3 = 0.422205 * q3 / b0;
+    const double b = 1.0 - (a1 + a2 + a3);
+
+    // Section III of [Triggs and Sdika 2006]. The matrix is scaled by B since the anti-causal
+    // pass multiplies its input by B as well.
+    const double scale = b / ((1.0 + a1 - a2 + a3) * (1.0 - a1 - a2 - a3) * (1.0 + a2 + (a1 - a3) * a3));
+    const double boundary[9] = {
+        scale * (-a3 * a1 + 1.0 - a3 * a3 - a2),
+        scale * (a3 + a1) * (a2 + a3 * a1),
+        scale * a3 * (a1 + a3 * a2),
+        scale * (a1 + a3 * a2),
+        -scale * (a2 - 1.0) * (a2 + a3 * a1),
+        -scale * a3 * (a3 * a1 + a3 * a3 + a2 - 1.0),
+        scale * (a3 * a1 + a2 + a1 * a1 - a2 * a2),
+        scale * (a1 * a2 + a3 * a2 * a2 - a1 * a3 * a3 - a3 * a3 * a3 - a3 * a2 + a3),
+        scale * a3 * (a1 + a3 * a2)
+    };
+
+    const float coefficients[4] = {
+        static_cast<float>(b), static_cast<float>(a1), static_cast<float>(a2), static_cast<float>(a3)
+    };
+    float boundaryF[9];
+    for (int i = 0; i < 9; ++i) {
+        boundaryF[i] = static_cast<float>(boundary[i]);
+    }
+    return Gaussian2D(coefficients, boundaryF, stddev);
+}
+
+Gaussian2D create2DGaussian(const float stddev, const GaussianFilterMode mode)
+{
+    return (mode == GaussianFilterMode::Recursive) ? create2DRecursiveGaussian(stddev) : create2DGaussian(stddev);
+}
+
+std::vector<float> computeIncrementalStddevs(int intervals, float stddev, float inputStddev)
+{
+    if (intervals < 1) {
+        throw std::invalid_argument("There must be at least one interval per octave.");
+    }
+
+    std::vector<float> stddevs(intervals + 3);
+    stddevs[0] = std::sqrt(std::max(stddev * stddev - inputStddev * inputStddev, 0.0f));
+
+    // Convolving G(a) with G(b) gives G(sqrt(a^2 + b^2)) so going from sigma_{i - 1}
+    // to sigma_i takes a Gaussian with std dev sqrt(sigma_i^2 - sigma_{i - 1}^2).
+    const double k = std::pow(2.0, 1.0 / intervals);
+    double prevStddev = stddev;
+    for (int i = 1; i < intervals + 3; ++i) {
+        const double currStddev = prevStddev * k;
+        stddevs[i] = static_cast<float>(std::sqrt(currStddev * currStddev - prevStddev * prevStddev));
+        prevStddev = currStddev;
+    }
+    return stddevs;
+}
+
 Image convolveGaussian2D(const Gaussian2D& gaussian, const Image& image)
 {
-    Image retImage(image);
-    convolveGaussian2DInPlace(gaussian, &retImage);
+    Image retImage;
+    convolveSeparable(gaussian, image, &retImage);
     return retImage;
 }
 
+void convolveGaussian2D(const Gaussian2D& gaussian, const ConstImageView& src, const ImageView& dst)
+{
+    convolveSeparable(gaussian, src, dst);
+}
+
 void convolveGaussian2DInPlace(const Gaussian2D& gaussian, Image* image)
 {
     assert(image != nullptr);
+    convolveSeparable(gaussian, *image, image);
 }
 
-DoGScaleSpacePyramid::DoGScaleSpacePyramid(const Image& image, int octaves, float stddev):
-    _octaves(octaves), _stddev(stddev)
+Image convolveGaussian2DReference(const Gaussian2D& gaussian, const Image& image)
 {
+    const int width = image.getWidth();
+    const int height = image.getHeight();
+    const int channels = image.getChannels();
+    const int radius = gaussian.getRadius();
+    const float* taps = gaussian.getTaps();
+
+    Image tmpImage(width, height, channels);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                float sum = 0.0f;
+                for (int k = -radius; k <= radius; ++k) {
+                    const int sx = std::min(std::max(x + k, 0), width - 1);
+                    sum += taps[std::abs(k)] * image.getColor(sx, y, c);
+                }
+                tmpImage.setColor(sum, x, y, c);
+            }
+        }
+    }
+
+    Image retImage(width, height, channels);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                float sum = 0.0f;
+                for (int k = -radius; k <= radius; ++k) {
+                    const int sy = std::min(std::max(y + k, 0), height - 1);
+                    sum += taps[std::abs(k)] * tmpImage.getColor(x, sy, c);
+                }
+                retImage.setColor(sum, x, y, c);
+            }
+        }
+    }
+    return retImage;
+}
+
+DoGScaleSpacePyramid::DoGScaleSpacePyramid(const ConstImageView& image, int octaves, float stddev, int intervals,
+                                           GaussianFilterMode filterMode, size_t memoryBudget,
+                                           bool upsampleFirstOctave):
+    _width(0), _height(0), _channels(0), _inputWidth(0), _inputHeight(0),
+    _requestedOctaves(octaves), _octaves(0), _firstOctave(0), _stddev(stddev), _intervals(intervals),
+    _filterMode(filterMode), _memoryBudget(memoryBudget), _upsampleFirstOctave(upsampleFirstOctave)
+{
+    createGaussians();
     initialize(image);
 }
 
-void DoGScaleSpacePyramid::initialize(const Image& image)
+template<typename T>
+DoGScaleSpacePyramid::DoGScaleSpacePyramid(const BasicImageView<T>& image, int octaves, float stddev,
+                                           int intervals, GaussianFilterMode filterMode, size_t memoryBudget,
+                                           bool upsampleFirstOctave):
+    _width(0), _height(0), _channels(0), _inputWidth(0), _inputHeight(0),
+    _requestedOctaves(octaves), _octaves(0), _firstOctave(0), _stddev(stddev), _intervals(intervals),
+    _filterMode(filterMode), _memoryBudget(memoryBudget), _upsampleFirstOctave(upsampleFirstOctave)
 {
-    _dogs.resize(_octaves);
+    createGaussians();
+    initialize(image);
+}
 
-    Gaussian2D gaussian = create2DGaussian(_stddev);
+void DoGScaleSpacePyramid::createGaussians()
+{
+    if (_requestedOctaves < 1 && _requestedOctaves != -1) {
+        throw std::invalid_argument("The number of octaves must be positive or -1.");
+    }
+
+    if (_intervals < 1) {
+        throw std::invalid_argument("There must be at least one interval per octave.");
+    }
+
+    if (_upsampleFirstOctave && _stddev <= 2.0f * kAssumedInputStddev) {
+        throw std::invalid_argument("The std dev must be larger than the blur of the upsampled image.");
+    }
+
+    // [Lowe 2004] divides each octave into s intervals, so k = 2^(1 / s) and Gaussian image i
+    // of each octave has a std dev of sigma_i = _stddev * k^i. s + 3 Gaussian images are needed
+    // so that extrema detection covers s full scales with a DoG image above and below each.
+    // Since G(a) * G(b) * I(x, y) = G(sqrt(a^2 + b^2)) * I(x, y), Gaussian image i is created from
+    // Gaussian image i - 1 by only applying the difference G(sqrt(sigma_i^2 - sigma_{i - 1}^2)),
+    // which is much narrower than G(sigma_i). These incremental Gaussians are the same for every octave.
+    const std::vector<float> stddevs = computeIncrementalStddevs(_intervals, _stddev);
+    _gaussians.reserve(stddevs.size());
+    for (float incrementalStddev : stddevs) {
+        _gaussians.push_back(create2DGaussian(incrementalStddev, _filterMode));
+    }
+}
 
-    // Between each octave, the image shrinks in size by a factor of 2
-    // and the std dev of the effective applied Gaussian doubles.
-    // Assume we are given a Gaussian with stddev s, G(s), and an image I(x, y).
-    // Convolve and get G(s) * I(x, y) which is the image convolved with a 
-    // Gaussian with stddev s.
-    // Note that if we do G(s) * G(s) * I(x,y), then we get an image convolved
-    // with a Gaussian with stddev sqrt(2) * s.
-    // Applying again gets G(s) * G(sqrt(2) * s) * I(x, y) which is effectively
-    // applying a Gaussian with sqrt(3) s and so on and so forth.
-    // The next iteration will result in a Gaussian with twice the std dev (the 4th application).
-    // As specified in [Lowe 2004], this image is used to resample for the next octave.
+size_t DoGScaleSpacePyramid::estimateMemory(int width, int height, int channels, int octaves, int intervals)
+{
+    return computePyramidLayout(width, height, channels, octaves, intervals, nullptr).size * sizeof(float);
+}
 
-    Image nextOctaveImage(image);
-    Image prevScaleImage;
-    Image currScaleImage;
+ConstImageView DoGScaleSpacePyramid::getDoG(int octave, int scale) const
+{
+    assert(octave >= 0 && octave < _octaves);
+    assert(scale >= 0 && scale < getDoGsPerOctave());
+    return ConstImageView(_arena.data() + _dogOffsets[octave * getDoGsPerOctave() + scale],
+                          _width >> octave, _height >> octave, _channels);
+}
+
+void DoGScaleSpacePyramid::computeOctaves(int width, int height, int channels)
+{
+    // An upsampled first octave is octave -1 of the image and counts like any other octave.
+    const int upsampling = _upsampleFirstOctave ? 1 : 0;
+    if (std::max(width, height) > (std::numeric_limits<int>::max() >> upsampling)) {
+        throw std::invalid_argument("The image is too large to be upsampled.");
+    }
+    const int minSide = std::min(width, height) << upsampling;
+    int maxOctaves = 1;
+    while ((minSide >> maxOctaves) >= kMinOctaveSize) {
+        ++maxOctaves;
+    }
+
+    if (_requestedOctaves == -1) {
+        _octaves = maxOctaves;
+    } else {
+        int possibleOctaves = 1;
+        while ((minSide >> possibleOctaves) >= 1) {
+            ++possibleOctaves;
+        }
+
+        if (_requestedOctaves > possibleOctaves) {
+            throw std::invalid_argument("The image is too small for the requested number of octaves.");
+        }
+        _octaves = _requestedOctaves;
+    }
+
+    // The finest octave takes up three quarters of the memory so dropping it is the only
+    // thing that makes a real difference.
+    _firstOctave = -upsampling;
+    while (_memoryBudget != 0 &&
+           estimateMemory(getOctaveSize(width, _firstOctave), getOctaveSize(height, _firstOctave), channels, _octaves,
+                          _intervals) > _memoryBudget) {
+        if (_octaves == 1) {
+            throw std::invalid_argument("A single octave of the pyramid does not fit into the memory budget.");
+        }
+        ++_firstOctave;
+        --_octaves;
+    }
+}
+
+void DoGScaleSpacePyramid::initialize(const ConstImageView& image)
+{
+    initialize<const float>(image);
+}
+
+template<typename T>
+void DoGScaleSpacePyramid::initialize(const BasicImageView<T>& image)
+{
+    computeOctaves(image.getWidth(), image.getHeight(), image.getChannels());
+    _inputWidth = image.getWidth();
+    _inputHeight = image.getHeight();
+    _width = getOctaveSize(image.getWidth(), _firstOctave);
+    _height = getOctaveSize(image.getHeight(), _firstOctave);
+    _channels = image.getChannels();
+
+    if (_firstOctave < 0) {
+        // [Lowe 2004] assumes the upsampled image has twice the blur of the input.
+        const Gaussian2D gaussian = create2DGaussian(std::sqrt(_stddev * _stddev -
+                                                               4.0f * kAssumedInputStddev * kAssumedInputStddev));
+        _upsampleColumns = detail::computeUpsampleTable(_inputWidth, gaussian.getTaps(), gaussian.getRadius());
+        detail::expandResampleTable(_upsampleColumns, _channels, &_upsampleOffsets, &_upsampleWeights);
+        _upsampleRows = detail::computeUpsampleTable(_inputHeight, gaussian.getTaps(), gaussian.getRadius());
+    }
+
+    // Only reallocates if the arena has to grow. build writes every image before reading it so
+    // the arena is not zero filled.
+    computePyramidLayout(_width, _height, _channels, _octaves, _intervals, &_dogOffsets);
+    _arena.resizeUninitialized(estimateMemory(_width, _height, _channels, _octaves, _intervals) / sizeof(float));
+    build(image);
+}
+
+void DoGScaleSpacePyramid::rebuild(const ConstImageView& image)
+{
+    rebuild<const float>(image);
+}
+
+template<typename T>
+void DoGScaleSpacePyramid::rebuild(const BasicImageView<T>& image)
+{
+    if (image.getWidth() == _inputWidth && image.getHeight() == _inputHeight && image.getChannels() == _channels) {
+        build(image);
+    } else {
+        initialize(image);
+    }
+}
+
+template<typename T>
+void DoGScaleSpacePyramid::build(const BasicImageView<T>& image)
+{
+    const PyramidLayout layout = computePyramidLayout(_width, _height, _channels, _octaves, _intervals, nullptr);
+
+    float* arena = _arena.data();
+    float* gaussianImages[2] = { arena + layout.gaussianOffsets[0], arena + layout.gaussianOffsets[1] };
+    float* seed = arena + layout.seedOffset;
+    float* tmp = arena + layout.tmpOffset;
+    float* rowScratch = arena + layout.rowScratchOffset;
+
+    const size_t baseStride = static_cast<size_t>(_width) * _channels;
+    if (_firstOctave < 0) {
+        // Anything but interleaved floats is converted into the second Gaussian buffer first, which
+        // is free until the first interval is computed and a quarter of it holds the input.
+        size_t srcStride = static_cast<size_t>(_inputWidth) * _channels;
+        const float* src = gaussianImages[1];
+        if (image.isInterleaved()) {
+            src = getFloatRows(image.getData(), image.getStride(), gaussianImages[1], srcStride, _inputWidth,
+                               _inputHeight, _channels, &srcStride);
+        } else {
+            convertImageView(image, ImageView(gaussianImages[1], _inputWidth, _inputHeight, _channels));
+        }
+        upsampleAndConvolve(src, srcStride, _inputHeight, _channels, _upsampleOffsets, _upsampleWeights,
+                            _upsampleColumns.taps, _upsampleRows, gaussianImages[0], tmp);
+    } else if (_firstOctave == 0 && image.isInterleaved()) {
+        // The input image is assumed to already be blurred by kAssumedInputStddev.
+        convolveSeparable(_gaussians[0], image.getData(), image.getStride(), gaussianImages[0], baseStride,
+                          _width, _height, _channels, tmp, rowScratch);
+    } else if (_firstOctave == 0) {
+        // The levels are stored interleaved so any other input is interleaved into the second
+        // Gaussian buffer, which is free until the first interval is computed.
+        convertImageView(image, ImageView(gaussianImages[1], _width, _height, _channels));
+        convolveSeparable(_gaussians[0], gaussianImages[1], baseStride, gaussianImages[0], baseStride,
+                          _width, _height, _channels, tmp, rowScratch);
+    } else {
+        // Skipped octaves are never stored. Each one is reduced to the seed of the next octave by
+        // blurring to twice the base std dev and taking every other pixel, in one pass that never
+        // holds a full resolution blurred image.
+        const auto getSeedGaussian = [this](int o) {
+            const float currStddev = (o == 0) ? kAssumedInputStddev : _stddev;
+            return create2DGaussian(std::sqrt(4.0f * _stddev * _stddev - currStddev * currStddev));
+        };
+        Image seedImage = convolveGaussian2DAndDecimate(getSeedGaussian(0), image);
+        for (int o = 1; o < _firstOctave; ++o) {
+            seedImage = convolveGaussian2DAndDecimate(getSeedGaussian(o), ConstImageView(seedImage));
+        }
+        copyImageView(seedImage, ImageView(gaussianImages[0], _width, _height, _channels));
+    }
 
     for (int o = 0; o < _octaves; ++o) {
-        for (int s = 0; s < 5; ++s) {
-            if (s == 0) {
-                currScaleImage = convolveGaussian2D(gaussian, nextOctaveImage);
-            } else {
-                currScaleImage = convolveGaussian2D(gaussian, prevScaleImage);
-                _dogs[o].push_back(currScaleImage - prevScaleImage);
-            }
+        const int width = _width >> o;
+        const int height = _height >> o;
 
-            if (s == 4)  {
-                nextOctaveImage = currScaleImage;
+        // Every later octave starts from an image that already has a blur of _stddev.
+        const float* prevScaleImage = (o == 0) ? gaussianImages[0] : seed;
+        for (int s = 1; s < _intervals + 3; ++s) {
+            // The DoG image is written by the final pass of the blur while each row is still in cache.
+            float* currScaleImage = (prevScaleImage == gaussianImages[0]) ? gaussianImages[1] : gaussianImages[0];
+            float* dog = arena + _dogOffsets[o * getDoGsPerOctave() + s - 1];
+            const size_t stride = static_cast<size_t>(width) * _channels;
+            convolveSeparable(_gaussians[s], prevScaleImage, stride, currScaleImage, stride, width, height, _channels,
+                              tmp, rowScratch, dog);
 
-                // Uses the algorithm in Section 3 in [Lowe 2004] where we take
-                // every other pixel in each row and column.
-                resampleImageInPlace(&nextOctaveImage, 2, 2);
+            if (s == _intervals && o + 1 < _octaves) {
+                // Since k^s = 2 this image has twice the std dev of the first image of the octave. Uses the
+                // algorithm in Section 3 in [Lowe 2004] where we take every other pixel in each
+                // row and column, which halves the std dev relative to the new pixel spacing.
+                decimateImageView(ConstImageView(currScaleImage, width, height, _channels),
+                                  ImageView(seed, width / 2, height / 2, _channels), 2, 2);
             }
-            prevScaleImage = std::move(currScaleImage);
+            prevScaleImage = currScaleImage;
         }
     }
 }
 
+// Views of writable images are instantiated as well since they do not convert to read-only
+// views during template argument deduction.
+#define SIFT_INSTANTIATE_PYRAMID_INPUT(T)                                                             \
+    template DoGScaleSpacePyramid::DoGScaleSpacePyramid(const BasicImageView<T>&, int, float, int,     \
+                                                        GaussianFilterMode, size_t, bool);             \
+    template void DoGScaleSpacePyramid::initialize(const BasicImageView<T>&);                          \
+    template void DoGScaleSpacePyramid::rebuild(const BasicImageView<T>&);
+
+SIFT_INSTANTIATE_PYRAMID_INPUT(float)
+SIFT_INSTANTIATE_PYRAMID_INPUT(const float)
+SIFT_INSTANTIATE_PYRAMID_INPUT(half)
+SIFT_INSTANTIATE_PYRAMID_INPUT(const half)
+SIFT_INSTANTIATE_PYRAMID_INPUT(uint8_t)
+SIFT_INSTANTIATE_PYRAMID_INPUT(const uint8_t)
+SIFT_INSTANTIATE_PYRAMID_INPUT(uint16_t)
+SIFT_INSTANTIATE_PYRAMID_INPUT(const uint16_t)
+
+#undef SIFT_INSTANTIATE_PYRAMID_INPUT
+
 }
@@ -3,34 +3,229 @@
 // found in the LICENSE file. The SIFT algorithm is
 // patented and its use for commercial applications must be licensed.
 // See the LICENSE file for details.
+#pragma once
 
+#include "aligned_buffer.h"
+#include "convolution.h"
 #include "image.h"
+#include "image_view.h"
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 namespace sift
 {
 
-/*! A 2D Gaussian filter type.
+/*! The number of standard deviations after which a Gaussian kernel is truncated by default.
+ */
+const float kDefaultGaussianTruncation = 4.0f;
+
+/*! The largest kernel radius a Gaussian2D can store.
+ */
+const int kMaxGaussianRadius = 63;
+
+/*! The blur that is assumed to already be present in an input image due to the camera
+ *  as described in Section 3.3 of [Lowe 2004].
+ */
+const float kAssumedInputStddev = 0.5f;
+
+/*! How a Gaussian is applied to an image.
+ */
+enum class GaussianFilterMode
+{
+    /*! Convolution with the sampled and truncated kernel. Cost grows linearly with 'sigma'.
+     */
+    FIR,
+
+    /*! Third order recursive approximation of [Young and van Vliet 1995]. Cost per pixel
+     *  is independent of 'sigma'. See create2DRecursiveGaussian for its accuracy.
+     */
+    Recursive
+};
+
+/*! A 2D Gaussian filter type. Since the 2D Gaussian is separable and symmetric, only
+ *  the center tap and one side of the normalized 1D kernel are stored. The taps are
+ *  stored inline so the object can be copied per scale and per thread without any
+ *  allocation or reference counting. Recursive Gaussians store their filter
+ *  coefficients instead of taps.
  */
 class Gaussian2D
 {
 public:
-    explicit Gaussian2D(const std::shared_ptr<Image>& img);
+    /*! Creates the identity filter.
+     */
+    Gaussian2D();
+
+    /*! Creates a Gaussian from a set of precomputed taps.
+     *  @param[in] taps The center tap followed by the taps at offsets 1 to radius.
+     *  @param[in] radius The number of taps on each side of the center tap. Must not be larger than kMaxGaussianRadius.
+     *  @param[in] stddev The 'sigma' that was used to create the kernel.
+     */
+    Gaussian2D(const float* taps, int radius, float stddev);
+
+    /*! Creates a recursive Gaussian from precomputed coefficients.
+     *  @param[in] coefficients B, a1, a2 and a3 of the recursion w[n] = B x[n] + a1 w[n - 1] + a2 w[n - 2] + a3 w[n - 3].
+     *  @param[in] boundary Row-major 3x3 matrix used to start the anti-causal pass. See [Triggs and Sdika 2006].
+     *  @param[in] stddev The 'sigma' that was used to compute the coefficients.
+     */
+    Gaussian2D(const float* coefficients, const float* boundary, float stddev);
+
+    /*! Retrieves how the Gaussian is applied.
+     *  @return GaussianFilterMode::Recursive if the Gaussian stores recursive coefficients.
+     */
+    GaussianFilterMode getMode() const { return _mode; }
+
+    /*! Retrieves the radius of the kernel.
+     *  @return The number of taps on each side of the center tap.
+     */
+    int getRadius() const { return _radius; }
+
+    /*! Retrieves the 'sigma' of the Gaussian.
+     *  @return The standard deviation used to create the kernel.
+     */
+    float getStddev() const { return _stddev; }
+
+    /*! Retrieves the kernel taps starting from the center. Since the kernel is symmetric,
+     *  getTaps()[k] is the weight applied at an offset of both -k and k.
+     *  Recursive Gaussians only store the identity tap.
+     *  @return Pointer to getRadius() + 1 taps.
+     */
+    const float* getTaps() const { return _taps; }
+
+    /*! Retrieves the coefficients of a recursive Gaussian.
+     *  @return Pointer to B, a1, a2 and a3.
+     */
+    const float* getRecursiveCoefficients() const { return _recursiveCoefficients; }
+
+    /*! Retrieves the boundary matrix of a recursive Gaussian.
+     *  @return Pointer to the 9 elements of the row-major 3x3 matrix.
+     */
+    const float* getRecursiveBoundary() const { return _recursiveBoundary; }
+
+private:
+    alignas(16) float _taps[kMaxGaussianRadius + 1];
+    int _radius;
+    float _stddev;
+    GaussianFilterMode _mode;
+    float _recursiveCoefficients[4];
+    float _recursiveBoundary[9];
+};
+
+/*! \brief A thread-safe cache of Gaussian kernels keyed by 'sigma' and truncation.
+ *
+ *  Both keys are quantized to multiples of 1/kQuantization and the kernel is built from the
+ *  quantized values so that the returned taps do not depend on which caller populated the cache.
+ *  Lookups never take a lock: the kernels live in an immutable map that is replaced
+ *  wholesale (copy-on-write) whenever a new kernel is inserted.
+ */
+class GaussianKernelCache
+{
+public:
+    /*! Number of quantization steps per unit of 'sigma' and truncation.
+     */
+    static const int kQuantization = 65536;
+
+    /*! Maximum number of kernels that are stored. Kernels requested after the cache
+     *  is full are computed but not inserted.
+     */
+    static const size_t kMaxEntries = 256;
+
+    /*! Creates an empty cache.
+     */
+    GaussianKernelCache();
+
+    /*! Retrieves a kernel from the cache, creating and inserting it if it does not exist yet.
+     *  @param[in] stddev The 'sigma' of the Gaussian function.
+     *  @param[in] truncation The number of standard deviations to sample before the kernel is cut off.
+     *  @return The Gaussian for the quantized 'sigma' and truncation.
+     */
+    Gaussian2D get(float stddev, float truncation = kDefaultGaussianTruncation);
+
+    /*! Populates the cache with every kernel that a DoG pyramid with the given configuration uses.
+     *  Meant to be called once at startup so that building pyramids never has to create a kernel.
+     *  @param[in] intervals The number of scale intervals per octave.
+     *  @param[in] stddev The std dev of the first Gaussian in each octave.
+     *  @param[in] truncation The number of standard deviations to sample before the kernel is cut off.
+     */
+    void precompute(int intervals, float stddev, float truncation = kDefaultGaussianTruncation);
+
+    /*! Retrieves the number of cached kernels.
+     *  @return Number of kernels stored in the cache.
+     */
+    size_t size() const;
+
+    /*! Removes all kernels from the cache.
+     */
+    void clear();
+
+    /*! Retrieves the cache that is used by create2DGaussian.
+     *  @return The process-wide kernel cache.
+     */
+    static GaussianKernelCache& global();
+
 private:
-    std::shared_ptr<Image> _filter;
+    typedef std::pair<int64_t, int64_t> Key;
+    typedef std::map<Key, Gaussian2D> KernelMap;
+
+    /*! Only ever accessed with std::atomic_load and std::atomic_store.
+     */
+    std::shared_ptr<const KernelMap> _kernels;
+
+    /*! Serializes writers so that concurrent inserts do not drop each other's kernels.
+     */
+    std::mutex _writeMutex;
 };
 
-/*! Creates a 2D Gaussian operator that can be convolved with an image.
- *  @param[in] stddev The 'sigma' of the Gaussian function. 
- *  @return An 'Image' object that contains an appropriately sized 2D Gaussian operator.
+/*! Creates a 2D Gaussian operator that can be convolved with an image. Kernels are
+ *  retrieved from GaussianKernelCache::global() so repeated calls are cheap.
+ *  @param[in] stddev The 'sigma' of the Gaussian function. A 'sigma' of zero creates the identity filter.
+ *  @param[in] truncation The number of standard deviations to sample before the kernel is cut off.
+ *                        Throws std::invalid_argument if the resulting radius is larger than kMaxGaussianRadius.
+ *  @return A Gaussian with normalized taps that covers [-ceil(truncation * stddev), ceil(truncation * stddev)].
  */
-Gaussian2D create2DGaussian(const float stddev);
+Gaussian2D create2DGaussian(const float stddev, const float truncation = kDefaultGaussianTruncation);
+
+/*! Creates a recursive 2D Gaussian [Young and van Vliet 1995] with the boundary handling
+ *  of [Triggs and Sdika 2006]. Its cost per pixel does not depend on 'sigma' which makes it
+ *  cheaper than the FIR Gaussian for the wide blurs at the top of each octave.
+ *
+ *  The recursion is an approximation. Compared to the FIR path (truncated at 4 sigma) on
+ *  uniform noise in [0, 1], which is the worst case, the largest per-pixel difference is
+ *  about 6e-2 for a 'sigma' of 1, 2e-2 for 2, 5e-3 for 4 and 3e-3 for 10. The peak of the
+ *  2D impulse response is off by about 10% for a 'sigma' of 1 and by 3% to 7% for a 'sigma'
+ *  of 2 and above. Constant regions, including image borders, are preserved. The recursion
+ *  is not valid for 'sigma' below 0.5, so a FIR Gaussian is returned in that case.
+ *  @param[in] stddev The 'sigma' of the Gaussian function.
+ *  @return A Gaussian whose mode is GaussianFilterMode::Recursive.
+ */
+Gaussian2D create2DRecursiveGaussian(const float stddev);
+
+/*! Creates a 2D Gaussian that is applied with the given mode.
+ *  @param[in] stddev The 'sigma' of the Gaussian function.
+ *  @param[in] mode Whether to create a FIR (create2DGaussian) or recursive (create2DRecursiveGaussian) Gaussian.
+ *  @return The Gaussian.
+ */
+Gaussian2D create2DGaussian(const float stddev, const GaussianFilterMode mode);
+
+/*! Computes the std devs of the Gaussians that have to be applied one after the other to build
+ *  the Gaussian images of one octave as described in Section 3 of [Lowe 2004]. The i-th Gaussian
+ *  image of an octave has a 'sigma' of stddev * 2^(i / intervals) and there are intervals + 3 of them.
+ *  @param[in] intervals The number of scale intervals per octave.
+ *  @param[in] stddev The std dev of the first Gaussian image in each octave.
+ *  @param[in] inputStddev The blur already present in the image the first Gaussian image is created from.
+ *  @return intervals + 3 std devs. Element 0 takes the input image to 'stddev' and element i
+ *          takes Gaussian image i - 1 to Gaussian image i.
+ */
+std::vector<float> computeIncrementalStddevs(int intervals, float stddev, float inputStddev = kAssumedInputStddev);
 
 /*! Convolve a 2D Gaussian with an image while taking advantage of the fact that
- *  the kernel is separable.
+ *  the kernel is separable. The channels of planar images are filtered one plane at a time.
  *  @param[in] gaussian The Gaussian to use for convolution.
  *  @param[in] image The image to convolve the Gaussian with.
- *  @return A new image that contains the convolved image data.
+ *  @return A new image that contains the convolved image data in the memory layout of 'image'.
  */
 Image convolveGaussian2D(const Gaussian2D& gaussian, const Image& image);
 
@@ -41,6 +236,23 @@ Image convolveGaussian2D(const Gaussian2D& gaussian, const Image& image);
  */
 void convolveGaussian2DInPlace(const Gaussian2D& gaussian, Image* image);
 
+/*! Convolve a 2D Gaussian with a view of an image, e.g. a crop, without copying it. Pixels outside
+ *  of the view are not read, the view is clamped at its own border.
+ *  @param[in] gaussian The Gaussian to use for convolution.
+ *  @param[in] src The pixels to convolve the Gaussian with.
+ *  @param[out] dst Receives the result. Must have the size of 'src'. May be the same view as 'src'
+ *                  but must not overlap it otherwise.
+ */
+void convolveGaussian2D(const Gaussian2D& gaussian, const ConstImageView& src, const ImageView& dst);
+
+/*! Straightforward scalar implementation of convolveGaussian2D. This is much slower and
+ *  only exists as the ground truth that the optimized convolution is tested against.
+ *  @param[in] gaussian The Gaussian to use for convolution.
+ *  @param[in] image The image to convolve the Gaussian with.
+ *  @return A new image that contains the convolved image data.
+ */
+Image convolveGaussian2DReference(const Gaussian2D& gaussian, const Image& image);
+
 /*! The Difference of Gaussian (DoG) Scale Space Pyramid described in [Lowe 2004]
  *  in Section 3.
  */
@@ -48,26 +260,170 @@ class DoGScaleSpacePyramid
 {
 public:
     /*! Creates a DoG scale-space pyramid as described by [Lowe 2004].
-     *  @param[in] image The original image to create the pyramid from.
+     *  @param[in] image The original image to create the pyramid from. Can be an Image or any view
+     *                   of one, e.g. a crop, which is read without making a copy.
      *  @param[in] octaves The number of octaves to use in the pyramid. 
      *                     If -1, computes the number of octaves automatically
-     *                     from the size of the image.
+     *                     from the size of the image so that the smallest side of
+     *                     the last octave is at least kMinOctaveSize pixels.
      *  @param[in] stddev The initial std dev of the Gaussian at each octave.
+     *  @param[in] intervals The number of intervals 's' each octave is divided into. Each octave
+     *                       has s + 3 Gaussian images and s + 2 DoG images. More intervals find
+     *                       more keypoints at the cost of more blurring per octave.
+     *  @param[in] filterMode How the Gaussians of the pyramid are applied.
+     *  @param[in] memoryBudget The maximum number of bytes, as given by estimateMemory, the pyramid may use.
+     *                          If the full pyramid does not fit, the finest octaves are skipped which
+     *                          lowers both the base resolution and the number of octaves. Zero means unlimited.
+     *  @param[in] upsampleFirstOctave Whether to double the size of the image before the first octave,
+     *                                 which [Lowe 2004] does to find about four times as many keypoints.
+     *                                 The first octave is then octave -1 of the image and, if the number of
+     *                                 octaves is computed automatically, the pyramid has one more octave.
+     *                                 The upsampling is linear and folded into the first blur, which is
+     *                                 always FIR, so no upsampled image that is not yet blurred is stored.
+     *                                 The upsampled image is assumed to have twice the blur of the input,
+     *                                 so 'stddev' must be larger than that. The memory budget drops the
+     *                                 upsampled octave first.
+     */
+    DoGScaleSpacePyramid(const ConstImageView& image, int octaves = -1, float stddev = 1.6f, int intervals = 3,
+                         GaussianFilterMode filterMode = GaussianFilterMode::FIR, size_t memoryBudget = 0,
+                         bool upsampleFirstOctave = false);
+
+    /*! Creates a DoG scale-space pyramid from a view of an image of any pixel type, e.g. the view of
+     *  an Image8 that was loaded from a file. The pixels are converted to float by the first blur of
+     *  the pyramid as it reads them (see PixelTraits), so no float copy of the input is made.
+     *  See the other constructor for the parameters.
+     */
+    template<typename T>
+    DoGScaleSpacePyramid(const BasicImageView<T>& image, int octaves = -1, float stddev = 1.6f,
+                         int intervals = 3, GaussianFilterMode filterMode = GaussianFilterMode::FIR,
+                         size_t memoryBudget = 0, bool upsampleFirstOctave = false);
+
+    /*! Does the work in actually creating the pyramid given the stored number of octaves, intervals, and stddev.
+     *  @param[in] The original image to create the pyramid from.
      */
-    DoGScaleSpacePyramid(const Image& image, int octaves = -1, float stddev = 1.6f);
+    void initialize(const ConstImageView& image);
 
-    /*! Does the work in actually creating the pyramid given the stored number of octaves, and stddev.
+    /*! Same as initialize for images of any pixel type.
      *  @param[in] The original image to create the pyramid from.
      */
-    void initialize(const Image& image);
+    template<typename T>
+    void initialize(const BasicImageView<T>& image);
+
+    /*! Recreates the pyramid for a new image. If the image has the same size and number of channels
+     *  as the previous one, every level, working image and scratch buffer of the pyramid is reused
+     *  and no memory is allocated, unless octaves have to be skipped to meet the memory budget.
+     *  Otherwise this is the same as initialize. Meant for streams of same-sized frames.
+     *  @param[in] image The original image to create the pyramid from.
+     */
+    void rebuild(const ConstImageView& image);
+
+    /*! Same as rebuild for images of any pixel type.
+     *  @param[in] image The original image to create the pyramid from.
+     */
+    template<typename T>
+    void rebuild(const BasicImageView<T>& image);
+
+    /*! Computes the number of bytes a pyramid needs. All DoG images, the working images that are
+     *  used while the pyramid is created and the scratch memory of the convolutions share a single
+     *  allocation of exactly this size.
+     *  @param[in] width Width of the first octave.
+     *  @param[in] height Height of the first octave.
+     *  @param[in] channels Number of image channels.
+     *  @param[in] octaves Number of octaves.
+     *  @param[in] intervals Number of intervals per octave.
+     *  @return The size in bytes.
+     */
+    static size_t estimateMemory(int width, int height, int channels, int octaves, int intervals);
+
+    /*! The smallest side length, in pixels, of the last octave when the number of octaves is computed automatically.
+     */
+    static const int kMinOctaveSize = 8;
+
+    /*! Retrieves the number of octaves in the pyramid.
+     *  @return Number of octaves.
+     */
+    int getOctaves() const { return _octaves; }
+
+    /*! Retrieves the octave of the original image that the first octave of the pyramid corresponds to.
+     *  This is larger than zero when octaves were skipped to stay within the memory budget and -1 when
+     *  the first octave is upsampled. Pixel coordinates in octave o have to be scaled by
+     *  2^(getFirstOctave() + o) to get to the original image.
+     *  @return Index of the first octave relative to the original image.
+     */
+    int getFirstOctave() const { return _firstOctave; }
+
+    /*! Retrieves the number of intervals each octave is divided into.
+     *  @return Number of intervals per octave.
+     */
+    int getIntervals() const { return _intervals; }
+
+    /*! Retrieves the number of DoG images in each octave.
+     *  @return getIntervals() + 2.
+     */
+    int getDoGsPerOctave() const { return _intervals + 2; }
+
+    /*! Retrieves a DoG image. The view points into the pyramid and is valid until the pyramid is
+     *  destroyed or initialized again.
+     *  @param[in] octave The octave of the image.
+     *  @param[in] scale The scale space sample within the octave. Must be less than getDoGsPerOctave().
+     *  @return The difference between Gaussian image scale + 1 and Gaussian image scale of the octave.
+     */
+    ConstImageView getDoG(int octave, int scale) const;
 
 private:
-    /*! Difference of Gaussian images. Indexed first by octave, then by scale space sample.
+    /*! Checks the parameters and creates _gaussians.
+     */
+    void createGaussians();
+
+    /*! Computes _octaves and _firstOctave for an image of the given size.
+     */
+    void computeOctaves(int width, int height, int channels);
+
+    /*! Fills in the levels of the pyramid. The layout of the arena must already match the image.
+     */
+    template<typename T>
+    void build(const BasicImageView<T>& image);
+
+    /*! Difference of Gaussian images followed by the working memory used to create them.
+     *  The DoG images of an octave are stored next to each other.
+     */
+    AlignedBuffer<float> _arena;
+
+    /*! Offset of every DoG image into _arena. Indexed by octave * getDoGsPerOctave() + scale.
+     */
+    std::vector<size_t> _dogOffsets;
+
+    /*! The incremental Gaussians of an octave as given by computeIncrementalStddevs.
+     */
+    std::vector<Gaussian2D> _gaussians;
+
+    /*! If the first octave is upsampled, the tables that upsample the image and apply the first
+     *  Gaussian in one pass per axis. The columns are expanded for the channels of the image.
+     */
+    detail::ResampleTable _upsampleColumns;
+    std::vector<int> _upsampleOffsets;
+    std::vector<float> _upsampleWeights;
+    detail::ResampleTable _upsampleRows;
+
+    /*! Size of the first octave.
+     */
+    int _width;
+    int _height;
+    int _channels;
+
+    /*! Size of the image the pyramid was last created from.
      */
-    std::vector<std::vector<Image > > _dogs;
+    int _inputWidth;
+    int _inputHeight;
 
+    int _requestedOctaves;
     int _octaves;
+    int _firstOctave;
     float _stddev;
+    int _intervals;
+    GaussianFilterMode _filterMode;
+    size_t _memoryBudget;
+    bool _upsampleFirstOctave;
 };
 
 }
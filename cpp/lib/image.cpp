@@ -4,45 +4,514 @@
 // patented and its use for commercial applications must be licensed.
 // See the LICENSE file for details.
 #include <cassert>
+#include "convolution.h"
+#include "elementwise.h"
 #include "image.h"
+#include "kernels.h"
+#include "parallel.h"
 #include <OpenImageIO/imageio.h>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <vector>
 
 namespace sift
 {
 
-Image::Image():
-    _width(0), _height(0), _channels(0)
+namespace
 {
+
+/*! Calls rowFunction(y, dstRow, rowSize) for every row of an expression, where dstRow
+ *  points to row y of 'dst' and rowSize is the number of floats in a row.
+ *  See detail::getExpressionRows for what the rows of planar images are.
+ */
+template<typename Expression, typename RowFunction>
+void forEachRow(const Expression& expression, const ImageView& dst, RowFunction rowFunction)
+{
+    const size_t rowSize = detail::getExpressionRowSize(expression);
+    const int rows = detail::getExpressionRows(expression);
+    for (int y = 0; y < rows; ++y) {
+        rowFunction(y, detail::getExpressionRowPointer(dst, expression.getPixelLayout(), y), rowSize);
+    }
+}
+
+/*! The type OpenImageIO decodes to and encodes from for each pixel type.
+ */
+template<typename T>
+OIIO::TypeDesc getTypeDesc();
+
+template<>
+OIIO::TypeDesc getTypeDesc<float>()
+{
+    return OIIO::TypeDesc::FLOAT;
+}
+
+template<>
+OIIO::TypeDesc getTypeDesc<half>()
+{
+    return OIIO::TypeDesc::HALF;
+}
+
+template<>
+OIIO::TypeDesc getTypeDesc<uint8_t>()
+{
+    return OIIO::TypeDesc::UINT8;
+}
+
+template<>
+OIIO::TypeDesc getTypeDesc<uint16_t>()
+{
+    return OIIO::TypeDesc::UINT16;
+}
+
+/*! Number of scanlines decoded at once from files that are not tiled. Files are decoded one band
+ *  of rows at a time so that neither OpenImageIO nor the conversions hold more than a band.
+ */
+const int kScanlineBandHeight = 16;
+
+/*! Closes and destroys an ImageInput, also when decoding throws.
+ */
+struct ImageInputDeleter
+{
+    void operator()(OIIO::ImageInput* in) const
+    {
+        in->close();
+        OIIO::ImageInput::destroy(in);
+    }
+};
+
+typedef std::unique_ptr<OIIO::ImageInput, ImageInputDeleter> ImageInputPtr;
+
+/*! Opens an image file for decoding.
+ *  @param[in] fname The file to open.
+ *  @return The open file. Throws ImageIOException if it cannot be opened.
+ */
+ImageInputPtr openImageInput(const std::string& fname)
+{
+    ImageInputPtr in(OIIO::ImageInput::open(fname));
+    if (!in) {
+        throw ImageIOException("Failed to load image from file: " + fname);
+    }
+    return in;
+}
+
+/*! Retrieves the number of rows decoded at once, which is a row of tiles for tiled files.
+ */
+int getBandHeight(const OIIO::ImageSpec& spec)
+{
+    return (spec.tile_width > 0 && spec.tile_height > 0) ? spec.tile_height : kScanlineBandHeight;
+}
+
+/*! Decodes the channels [chbegin, chend) of 'rows' rows starting at row y of an open file.
+ *  @param[in] in The file. Bands of tiled files must start at a multiple of the tile height.
+ *  @param[in] y First row, relative to the top of the image.
+ *  @param[in] rows Number of rows.
+ *  @param[in] chbegin First channel to decode.
+ *  @param[in] chend One past the last channel to decode.
+ *  @param[in] format The type to convert the pixels to.
+ *  @param[out] data Receives the pixels, with the decoded channels of a pixel next to each other.
+ *  @param[in] rowBytes Distance between two rows of 'data' in bytes.
+ */
+void readBand(OIIO::ImageInput* in, int y, int rows, int chbegin, int chend, OIIO::TypeDesc format, void* data,
+              OIIO::stride_t rowBytes)
+{
+    const OIIO::ImageSpec& spec = in->spec();
+    bool success;
+    if (spec.tile_width > 0 && spec.tile_height > 0) {
+        success = in->read_tiles(spec.x, spec.x + spec.width, spec.y + y, spec.y + y + rows, spec.z, spec.z + 1,
+                                 chbegin, chend, format, data, OIIO::AutoStride, rowBytes);
+    } else {
+        success = in->read_scanlines(spec.y + y, spec.y + y + rows, spec.z, chbegin, chend, format, data,
+                                     OIIO::AutoStride, rowBytes);
+    }
+    if (!success) {
+        throw ImageIOException("Failed to decode image: " + in->geterror());
+    }
+}
+
+/*! Compares two rows of pixels. Float rows use the vectorized comparison.
+ */
+template<typename T>
+bool equalRows(const T* lhs, const T* rhs, size_t count)
+{
+    return std::equal(lhs, lhs + count, rhs);
+}
+
+bool equalRows(const float* lhs, const float* rhs, size_t count)
+{
+    return detail::equalArrays(lhs, rhs, count);
+}
+
+/*! dst[i] = lhs[i] + rhs[i]. Other pixel types than float are added as floats (see PixelTraits),
+ *  so integer sums saturate.
+ */
+template<typename T>
+void addRows(const T* lhs, const T* rhs, T* dst, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = PixelTraits<T>::fromFloat(PixelTraits<T>::toFloat(lhs[i]) + PixelTraits<T>::toFloat(rhs[i]));
+    }
+}
+
+void addRows(const float* lhs, const float* rhs, float* dst, size_t count)
+{
+    detail::addArrays(lhs, rhs, dst, count);
+}
+
+/*! Number of elements below which splitting work across threads costs more than it saves.
+ */
+const size_t kParallelElements = 1 << 16;
+
+/*! Copies pixel Factor * i of 'src' to pixel i of 'dst' for every i < count, where a pixel is
+ *  'channels' consecutive elements. Factor is a compile time constant for the factors that
+ *  matter and 0 for any other 'factor'.
+ */
+template<int Factor, typename T>
+void decimateSpan(const T* src, T* dst, size_t count, int channels, int factor)
+{
+    const size_t pixelSize = static_cast<size_t>(channels);
+    const size_t step = static_cast<size_t>(Factor > 0 ? Factor : factor) * pixelSize;
+    for (size_t i = 0; i < count; ++i) {
+        std::copy(src + i * step, src + i * step + pixelSize, dst + i * pixelSize);
+    }
+}
+
+template<typename T>
+void decimateSpan(const T* src, T* dst, size_t count, int channels, int factor)
+{
+    if (factor == 2) {
+        decimateSpan<2>(src, dst, count, channels, factor);
+    } else {
+        decimateSpan<0>(src, dst, count, channels, factor);
+    }
+}
+
+void decimateSpan(const float* src, float* dst, size_t count, int channels, int factor)
+{
+    if (factor == 2) {
+        detail::getKernels().decimateSpan(src, dst, count, channels);
+    } else {
+        decimateSpan<0>(src, dst, count, channels, factor);
+    }
+}
+
+/*! Computes a * b for non-negative sizes and throws std::bad_alloc if the result does not fit
+ *  into a size_t, which is how AlignedBuffer reports sizes it cannot allocate.
+ */
+size_t checkedMultiply(size_t a, size_t b)
+{
+    if (b != 0 && a > std::numeric_limits<size_t>::max() / b) {
+        throw std::bad_alloc();
+    }
+    return a * b;
+}
+
+/*! Computes a + b for non-negative sizes and throws std::bad_alloc if the result does not fit
+ *  into a size_t.
+ */
+size_t checkedAdd(size_t a, size_t b)
+{
+    if (a > std::numeric_limits<size_t>::max() - b) {
+        throw std::bad_alloc();
+    }
+    return a + b;
 }
 
-Image::Image(const int width, const int height, const int channels)
+/*! Maps a coordinate outside of [0, size) to the pixel the halo repeats there.
+ */
+int mapBorderCoordinate(int i, int size, BorderMode border)
+{
+    if (border == BorderMode::Replicate) {
+        return std::min(std::max(i, 0), size - 1);
+    }
+
+    // The reflection has a period of 2 * size, which also covers halos wider than the image.
+    const int period = 2 * size;
+    i %= period;
+    if (i < 0) {
+        i += period;
+    }
+    return (i < size) ? i : period - 1 - i;
+}
+
+}
+
+template<typename T>
+BasicImage<T>::BasicImage():
+    _origin(0), _stride(0), _width(0), _height(0), _channels(0), _halo(0),
+    _padding(RowPadding::None), _layout(PixelLayout::Interleaved), _border(BorderMode::Replicate)
+{
+}
+
+template<typename T>
+BasicImage<T>::BasicImage(const int width, const int height, const int channels, const RowPadding padding,
+                          const PixelLayout layout):
+    _origin(0), _stride(0), _width(0), _height(0), _channels(0), _halo(0),
+    _padding(padding), _layout(layout), _border(BorderMode::Replicate)
 {
     resizeImage(width, height, channels);
 }
 
-void Image::resizeImage(const int width, const int height, const int channels)
+template<typename T>
+BasicImage<T>::BasicImage(const ConstView& view, const RowPadding padding, const PixelLayout layout):
+    _origin(0), _stride(0), _width(0), _height(0), _channels(0), _halo(0),
+    _padding(padding), _layout(layout), _border(BorderMode::Replicate)
+{
+    resizeImageUninitialized(view.getWidth(), view.getHeight(), view.getChannels());
+    convertImageView(view, getView());
+}
+
+template<typename T>
+void BasicImage<T>::resizeImage(const int width, const int height, const int channels)
 {
+    resizeImage(width, height, channels, _padding, _layout);
+}
+
+template<typename T>
+void BasicImage<T>::resizeImage(const int width, const int height, const int channels, const RowPadding padding)
+{
+    resizeImage(width, height, channels, padding, _layout);
+}
+
+template<typename T>
+void BasicImage<T>::resizeImage(const int width, const int height, const int channels, const RowPadding padding,
+                                const PixelLayout layout)
+{
+    resizeBuffer(width, height, channels, padding, layout, true);
+}
+
+template<typename T>
+void BasicImage<T>::resizeImageUninitialized(const int width, const int height, const int channels)
+{
+    resizeBuffer(width, height, channels, _padding, _layout, false);
+}
+
+template<typename T>
+void BasicImage<T>::resizeImageUninitialized(const int width, const int height, const int channels,
+                                             const RowPadding padding, const PixelLayout layout)
+{
+    resizeBuffer(width, height, channels, padding, layout, false);
+}
+
+template<typename T>
+void BasicImage<T>::resizeBuffer(int width, int height, int channels, RowPadding padding, PixelLayout layout,
+                                 bool zeroFill)
+{
+    if (width < 0 || height < 0 || channels < 0) {
+        throw std::invalid_argument("Image dimensions must not be negative.");
+    }
+
+    // With a halo every row has _halo extra pixels on both sides and every plane _halo extra
+    // rows above and below. The left part of the halo is rounded up to a cache line when the
+    // rows are padded so that pixel (0, y) stays aligned. Every size is computed with checked
+    // size_t arithmetic and the image is only changed once all of them are known to fit.
+    const size_t pixelStride = (layout == PixelLayout::Planar) ? 1 : static_cast<size_t>(channels);
+    size_t left = checkedMultiply(_halo, pixelStride);
+    if (padding == RowPadding::CacheLine) {
+        left = padRowSize(left, RowPadding::CacheLine, false);
+    }
+    const size_t rowSize = checkedAdd(left, checkedMultiply(checkedAdd(width, _halo), pixelStride));
+    const size_t stride = (width == 0) ? 0 : padRowSize(rowSize, padding, true);
+
+    // The planes of a planar image follow each other without a gap.
+    const size_t planeRows = checkedAdd(height, 2 * static_cast<size_t>(_halo));
+    const size_t rows = (layout == PixelLayout::Planar) ? checkedMultiply(planeRows, channels) : planeRows;
+    const size_t size = checkedMultiply(stride, rows);
+    if (zeroFill) {
+        _data.resize(size);
+    } else {
+        _data.resizeUninitialized(size);
+    }
+
     _width = width;
     _height = height;
     _channels = channels;
-    _data.resize(_width * _height * _channels);
+    _padding = padding;
+    _layout = layout;
+    _stride = stride;
+    _origin = static_cast<size_t>(_halo) * _stride + left;
 }
 
-void Image::loadFromFile(const std::string& fname)
+template<typename T>
+size_t BasicImage<T>::computeStride(int width, int channels, RowPadding padding, PixelLayout layout)
 {
-    OIIO::ImageInput* in = OIIO::ImageInput::open(fname);
-    if (!in) {
-        throw ImageIOException("Failed to load image from file: " + fname);
+    return padRowSize(checkedMultiply(width, (layout == PixelLayout::Planar) ? 1 : channels), padding, true);
+}
+
+template<typename T>
+size_t BasicImage<T>::padRowSize(size_t rowSize, RowPadding padding, bool avoidAliasing)
+{
+    if (padding == RowPadding::None || rowSize == 0) {
+        return rowSize;
+    }
+
+    const size_t cacheLine = AlignedBuffer<T>::kAlignment / sizeof(T);
+    size_t stride = checkedAdd(rowSize, cacheLine - 1) / cacheLine * cacheLine;
+    if (avoidAliasing && (stride * sizeof(T)) % 4096 == 0) {
+        stride = checkedAdd(stride, cacheLine);
+    }
+    return stride;
+}
+
+template<typename T>
+void BasicImage<T>::setHalo(const int halo, const BorderMode border)
+{
+    assert(halo >= 0);
+    if (halo != _halo) {
+        // Resized into a new image so that this one is unchanged if the allocation throws.
+        BasicImage resized;
+        resized._halo = halo;
+        resized.resizeImageUninitialized(_width, _height, _channels, _padding, _layout);
+        convertImageView(getView(), resized.getView());
+        *this = std::move(resized);
     }
+    _border = border;
+    fillHalo();
+}
 
+template<typename T>
+void BasicImage<T>::fillHalo()
+{
+    if (_halo == 0 || _width == 0 || _height == 0) {
+        return;
+    }
+
+    // Each pixel of a planar image is one float of a plane.
+    const bool planar = _layout == PixelLayout::Planar;
+    const int planes = planar ? _channels : 1;
+    const ptrdiff_t pixelStride = static_cast<ptrdiff_t>(getPixelStride());
+    const size_t extendedRowSize = static_cast<size_t>(_width + 2 * _halo) * pixelStride;
+    for (int p = 0; p < planes; ++p) {
+        // The left and right halo of every row and then whole rows, halo included, above and below.
+        for (int y = 0; y < _height; ++y) {
+            T* row = getRowPointer(y, p);
+            for (int x = -_halo; x < 0; ++x) {
+                const T* src = row + mapBorderCoordinate(x, _width, _border) * pixelStride;
+                std::copy(src, src + pixelStride, row + x * pixelStride);
+            }
+            for (int x = _width; x < _width + _halo; ++x) {
+                const T* src = row + mapBorderCoordinate(x, _width, _border) * pixelStride;
+                std::copy(src, src + pixelStride, row + x * pixelStride);
+            }
+        }
+
+        const auto fillRow = [&](int y) {
+            const T* src = getRowPointer(mapBorderCoordinate(y, _height, _border), p) - _halo * pixelStride;
+            std::copy(src, src + extendedRowSize, getRowPointer(y, p) - _halo * pixelStride);
+        };
+        for (int y = -_halo; y < 0; ++y) {
+            fillRow(y);
+        }
+        for (int y = _height; y < _height + _halo; ++y) {
+            fillRow(y);
+        }
+    }
+}
+
+template<typename T>
+void BasicImage<T>::loadFromFile(const std::string& fname)
+{
+    loadFromFile(fname, _layout);
+}
+
+template<typename T>
+void BasicImage<T>::loadFromFile(const std::string& fname, const PixelLayout layout)
+{
+    ImageInputPtr in = openImageInput(fname);
     const OIIO::ImageSpec& spec = in->spec();
-    resizeImage(spec.width, spec.height, spec.nchannels);
-    in->read_image(OIIO::TypeDesc::FLOAT, &_data[0]);
-    in->close();
-    OIIO::ImageInput::destroy(in);
+    resizeImageUninitialized(spec.width, spec.height, spec.nchannels, _padding, layout);
+    const int bandHeight = getBandHeight(spec);
+    if (_layout == PixelLayout::Interleaved) {
+        // The bands are decoded straight into the rows of the image.
+        for (int y = 0; y < _height; y += bandHeight) {
+            const int rows = std::min(bandHeight, _height - y);
+            readBand(in.get(), y, rows, 0, _channels, getTypeDesc<T>(), getRowPointer(y, 0), _stride * sizeof(T));
+        }
+    } else {
+        // Split every band into the planes while it is in cache instead of converting a whole
+        // interleaved copy of the image.
+        const size_t bandStride = static_cast<size_t>(_width) * _channels;
+        std::vector<T> band(bandStride * std::min(bandHeight, _height));
+        for (int y = 0; y < _height; y += bandHeight) {
+            const int rows = std::min(bandHeight, _height - y);
+            readBand(in.get(), y, rows, 0, _channels, getTypeDesc<T>(), band.data(), bandStride * sizeof(T));
+            for (int row = 0; row < rows; ++row) {
+                const T* scanline = band.data() + row * bandStride;
+                for (int c = 0; c < _channels; ++c) {
+                    T* dstRow = getRowPointer(y + row, c);
+                    for (int x = 0; x < _width; ++x) {
+                        dstRow[x] = scanline[static_cast<size_t>(x) * _channels + c];
+                    }
+                }
+            }
+        }
+    }
+    fillHalo();
 }
 
-void Image::saveToFile(const std::string& fname) const
+template<typename T>
+void BasicImage<T>::loadFromFileAsGrayscale(const std::string& fname, const GrayscaleWeights& weights)
+{
+    ImageInputPtr in = openImageInput(fname);
+    const OIIO::ImageSpec& spec = in->spec();
+    const int fileChannels = spec.nchannels;
+    resizeImageUninitialized(spec.width, spec.height, 1, _padding, _layout);
+    const int bandHeight = getBandHeight(spec);
+    if (fileChannels == 1) {
+        for (int y = 0; y < _height; y += bandHeight) {
+            const int rows = std::min(bandHeight, _height - y);
+            readBand(in.get(), y, rows, 0, 1, getTypeDesc<T>(), getRowPointer(y, 0), _stride * sizeof(T));
+        }
+    } else {
+        // Decode the channels that are needed as floats so that integer files are weighted at
+        // full precision, then round the luminance to T once.
+        const int usedChannels = (fileChannels < 3) ? 1 : 3;
+        const size_t bandStride = static_cast<size_t>(_width) * usedChannels;
+        std::vector<float> band(bandStride * std::min(bandHeight, _height));
+        for (int y = 0; y < _height; y += bandHeight) {
+            const int rows = std::min(bandHeight, _height - y);
+            readBand(in.get(), y, rows, 0, usedChannels, OIIO::TypeDesc::FLOAT, band.data(),
+                     bandStride * sizeof(float));
+            for (int row = 0; row < rows; ++row) {
+                const float* scanline = band.data() + row * bandStride;
+                T* dstRow = getRowPointer(y + row, 0);
+                if (usedChannels == 1) {
+                    for (int x = 0; x < _width; ++x) {
+                        dstRow[x] = PixelTraits<T>::fromFloat(scanline[x]);
+                    }
+                } else {
+                    for (int x = 0; x < _width; ++x) {
+                        const float* rgb = scanline + static_cast<size_t>(x) * 3;
+                        dstRow[x] = PixelTraits<T>::fromFloat(weights.red * rgb[0] + weights.green * rgb[1] +
+                                                              weights.blue * rgb[2]);
+                    }
+                }
+            }
+        }
+    }
+    fillHalo();
+}
+
+template<typename T>
+void streamImageFromFile(const std::string& fname,
+                         const std::function<void(const BasicImageView<const T>& rows, int y)>& consumer)
+{
+    ImageInputPtr in = openImageInput(fname);
+    const OIIO::ImageSpec& spec = in->spec();
+    const int bandHeight = getBandHeight(spec);
+    const size_t bandStride = static_cast<size_t>(spec.width) * spec.nchannels;
+    std::vector<T> band(bandStride * std::min(bandHeight, spec.height));
+    for (int y = 0; y < spec.height; y += bandHeight) {
+        const int rows = std::min(bandHeight, spec.height - y);
+        readBand(in.get(), y, rows, 0, spec.nchannels, getTypeDesc<T>(), band.data(), bandStride * sizeof(T));
+        consumer(BasicImageView<const T>(band.data(), spec.width, rows, spec.nchannels), y);
+    }
+}
+
+template<typename T>
+void BasicImage<T>::saveToFile(const std::string& fname) const
 {
     OIIO::ImageOutput* out = OIIO::ImageOutput::create(fname);
     if (!out) {
@@ -51,12 +520,26 @@ void Image::saveToFile(const std::string& fname) const
 
     OIIO::ImageSpec spec(_width, _height, _channels, OIIO::TypeDesc::UINT8);
     out->open(fname, spec);
-    out->write_image(OIIO::TypeDesc::FLOAT, _data.data());
+    if (_layout == PixelLayout::Interleaved) {
+        out->write_image(getTypeDesc<T>(), getData(), OIIO::AutoStride, _stride * sizeof(T));
+    } else {
+        std::vector<T> scanline(static_cast<size_t>(_width) * _channels);
+        for (int y = 0; y < _height; ++y) {
+            for (int c = 0; c < _channels; ++c) {
+                const T* srcRow = getRowPointer(y, c);
+                for (int x = 0; x < _width; ++x) {
+                    scanline[static_cast<size_t>(x) * _channels + c] = srcRow[x];
+                }
+            }
+            out->write_scanline(y, 0, getTypeDesc<T>(), scanline.data());
+        }
+    }
     out->close();
     OIIO::ImageOutput::destroy(out);
 }
 
-bool Image::operator==(const Image& rhs) const
+template<typename T>
+bool BasicImage<T>::operator==(const BasicImage& rhs) const
 {
     if (_width != rhs._width) {
         return false;
@@ -69,58 +552,465 @@ bool Image::operator==(const Image& rhs) const
     if (_channels != rhs._channels) {
         return false;
     }
-    assert(_data.size() == rhs._data.size());
-    for (size_t i = 0; i < _data.size(); ++i) {
-        if (_data[i] != rhs._data[i]) {
-            return false;
+
+    if (_layout != rhs._layout) {
+        for (int c = 0; c < _channels; ++c) {
+            for (int y = 0; y < _height; ++y) {
+                const T* lhsRow = getRowPointer(y, c);
+                const T* rhsRow = rhs.getRowPointer(y, c);
+                for (int x = 0; x < _width; ++x) {
+                    if (lhsRow[x * getPixelStride()] != rhsRow[x * rhs.getPixelStride()]) {
+                        return false;
+                    }
+                }
+            }
         }
+        return true;
     }
 
+    // The padding and the halo are not part of the image so the rows are compared one by one.
+    const ConstView lhsView = getView();
+    const ConstView rhsView = rhs.getView();
+    const size_t rowSize = detail::getExpressionRowSize(*this);
+    const int rows = detail::getExpressionRows(*this);
+    for (int y = 0; y < rows; ++y) {
+        if (!equalRows(detail::getExpressionRowPointer(lhsView, _layout, y),
+                       detail::getExpressionRowPointer(rhsView, _layout, y), rowSize)) {
+            return false;
+        }
+    }
     return true;
 }
 
-Image& Image::operator+=(const Image& rhs)
+template<typename T>
+BasicImage<T>& BasicImage<T>::operator+=(const BasicImage& rhs)
 {
-    for (size_t i = 0; i < _data.size(); ++i) {
-        _data[i] += rhs._data[i];
+    assert(_width == rhs._width && _height == rhs._height && _channels == rhs._channels && _layout == rhs._layout);
+    const View lhsView = getView();
+    const ConstView rhsView = rhs.getView();
+    const size_t rowSize = detail::getExpressionRowSize(*this);
+    const int rows = detail::getExpressionRows(*this);
+    for (int y = 0; y < rows; ++y) {
+        T* dstRow = detail::getExpressionRowPointer(lhsView, _layout, y);
+        addRows(dstRow, detail::getExpressionRowPointer(rhsView, _layout, y), dstRow, rowSize);
     }
     return *this;
 }
 
-Image Image::operator-() const
+namespace detail
+{
+
+void evaluateImageExpression(const ImageOperand& expression, const ImageView& dst)
 {
-    Image retImage(getWidth(), getHeight(), getChannels());
-    for (size_t i = 0; i < retImage._data.size(); ++i) {
-        retImage._data[i] = -_data[i];
+    if (expression.getView().getData() == dst.getData()) {
+        return;
     }
-    return retImage;
+
+    forEachRow(expression, dst, [&](int y, float* dstRow, size_t rowSize) {
+        std::copy(expression.getRowPointer(y), expression.getRowPointer(y) + rowSize, dstRow);
+    });
+}
+
+void evaluateImageExpression(const ScaledImage& expression, const ImageView& dst)
+{
+    const ImageOperand& operand = expression.getOperand();
+    const float scale = expression.getScale();
+    forEachRow(expression, dst, [&](int y, float* dstRow, size_t rowSize) {
+        if (scale == -1.0f) {
+            negateArray(operand.getRowPointer(y), dstRow, rowSize);
+        } else {
+            scaleArray(scale, operand.getRowPointer(y), dstRow, rowSize);
+        }
+    });
+}
+
+void evaluateImageExpression(const BinaryImageExpression<AddOperation, Image, Image>& expression,
+                             const ImageView& dst)
+{
+    const ImageOperand& lhs = expression.getLhs();
+    const ImageOperand& rhs = expression.getRhs();
+    forEachRow(expression, dst, [&](int y, float* dstRow, size_t rowSize) {
+        addArrays(lhs.getRowPointer(y), rhs.getRowPointer(y), dstRow, rowSize);
+    });
+}
+
+void evaluateImageExpression(const BinaryImageExpression<SubtractOperation, Image, Image>& expression,
+                             const ImageView& dst)
+{
+    const ImageOperand& lhs = expression.getLhs();
+    const ImageOperand& rhs = expression.getRhs();
+    forEachRow(expression, dst, [&](int y, float* dstRow, size_t rowSize) {
+        subtractArrays(lhs.getRowPointer(y), rhs.getRowPointer(y), dstRow, rowSize);
+    });
+}
+
+namespace
+{
+
+/*! Evaluates alpha * x + beta * y row by row.
+ */
+template<typename Expression>
+void evaluateAxpby(const Expression& expression, float alpha, const ImageOperand& x, float beta,
+                   const ImageOperand& y, const ImageView& dst)
+{
+    forEachRow(expression, dst, [&](int row, float* dstRow, size_t rowSize) {
+        axpbyArrays(alpha, x.getRowPointer(row), beta, y.getRowPointer(row), dstRow, rowSize);
+    });
+}
+
+}
+
+void evaluateImageExpression(const BinaryImageExpression<AddOperation, ScaledImage, Image>& expression,
+                             const ImageView& dst)
+{
+    const ScaledImage& lhs = expression.getLhs();
+    evaluateAxpby(expression, lhs.getScale(), lhs.getOperand(), 1.0f, expression.getRhs(), dst);
+}
+
+void evaluateImageExpression(const BinaryImageExpression<AddOperation, Image, ScaledImage>& expression,
+                             const ImageView& dst)
+{
+    const ScaledImage& rhs = expression.getRhs();
+    evaluateAxpby(expression, rhs.getScale(), rhs.getOperand(), 1.0f, expression.getLhs(), dst);
+}
+
+void evaluateImageExpression(const BinaryImageExpression<AddOperation, ScaledImage, ScaledImage>& expression,
+                             const ImageView& dst)
+{
+    const ScaledImage& lhs = expression.getLhs();
+    const ScaledImage& rhs = expression.getRhs();
+    evaluateAxpby(expression, lhs.getScale(), lhs.getOperand(), rhs.getScale(), rhs.getOperand(), dst);
 }
 
-Image resampleImage(const Image& image, float fx, float fy)
+void evaluateImageExpression(const BinaryImageExpression<SubtractOperation, ScaledImage, Image>& expression,
+                             const ImageView& dst)
 {
-    Image retImage(image);
-    resampleImageInPlace(&retImage, fx, fy);
+    const ScaledImage& lhs = expression.getLhs();
+    evaluateAxpby(expression, lhs.getScale(), lhs.getOperand(), -1.0f, expression.getRhs(), dst);
+}
+
+void evaluateImageExpression(const BinaryImageExpression<SubtractOperation, Image, ScaledImage>& expression,
+                             const ImageView& dst)
+{
+    const ScaledImage& rhs = expression.getRhs();
+    evaluateAxpby(expression, -rhs.getScale(), rhs.getOperand(), 1.0f, expression.getLhs(), dst);
+}
+
+void evaluateImageExpression(const BinaryImageExpression<SubtractOperation, ScaledImage, ScaledImage>& expression,
+                             const ImageView& dst)
+{
+    const ScaledImage& lhs = expression.getLhs();
+    const ScaledImage& rhs = expression.getRhs();
+    evaluateAxpby(expression, lhs.getScale(), lhs.getOperand(), -rhs.getScale(), rhs.getOperand(), dst);
+}
+
+}
+
+namespace
+{
+
+/*! Computes the source pixels and weights of every pixel along one axis of a resize. Pixels outside
+ *  of the source give their weight to the closest edge pixel.
+ */
+detail::ResampleTable computeResampleTable(int srcSize, int dstSize, float factor, ResampleMode mode)
+{
+    assert(mode != ResampleMode::Nearest && srcSize > 0);
+
+    // An area of 'factor' pixels touches at most ceil(factor) + 1 of them.
+    detail::ResampleTable table;
+    const int support = (mode == ResampleMode::Bilinear) ? 2 : static_cast<int>(std::ceil(factor)) + 1;
+    table.taps = std::min(support, srcSize);
+    table.first.resize(dstSize);
+    table.weights.assign(static_cast<size_t>(dstSize) * table.taps, 0.0f);
+
+    for (int i = 0; i < dstSize; ++i) {
+        float* weights = table.weights.data() + static_cast<size_t>(i) * table.taps;
+        int first = 0;
+        const auto addWeight = [&](int pixel, double weight) {
+            weights[std::min(std::max(pixel, 0), srcSize - 1) - first] += static_cast<float>(weight);
+        };
+
+        if (mode == ResampleMode::Bilinear) {
+            // Pixel centers are at half integers in both images.
+            const double center = (i + 0.5) * factor - 0.5;
+            const int left = static_cast<int>(std::floor(center));
+            first = std::min(std::max(left, 0), srcSize - table.taps);
+            addWeight(left, 1.0 - (center - left));
+            addWeight(left + 1, center - left);
+        } else {
+            const double begin = static_cast<double>(i) * factor;
+            const double end = std::min(begin + factor, static_cast<double>(srcSize));
+            const int left = std::min(static_cast<int>(begin), srcSize - 1);
+            first = std::min(left, srcSize - table.taps);
+            if (end <= begin) {
+                addWeight(left, 1.0);
+            }
+            for (int pixel = left; pixel < end; ++pixel) {
+                addWeight(pixel, (std::min(end, pixel + 1.0) - std::max(begin, static_cast<double>(pixel))) /
+                                 (end - begin));
+            }
+        }
+        table.first[i] = first;
+    }
+    return table;
+}
+
+/*! Reads row 'y' of plane 'plane' as floats. Float rows are used in place and the rows of other
+ *  pixel types are converted into 'scratch', which must hold 'count' floats.
+ */
+template<typename T>
+const float* getFloatRow(const BasicImage<T>& image, int y, int plane, size_t count, float* scratch)
+{
+    const T* row = image.getRowPointer(y, plane);
+    std::transform(row, row + count, scratch, PixelTraits<T>::toFloat);
+    return scratch;
+}
+
+const float* getFloatRow(const Image& image, int y, int plane, size_t, float*)
+{
+    return image.getRowPointer(y, plane);
+}
+
+/*! Retrieves where to compute row 'y' of plane 'plane' as floats: the row itself for float
+ *  images and 'scratch' for other pixel types, which storeFloatRow then converts into the row.
+ */
+template<typename T>
+float* getFloatRowForWriting(BasicImage<T>*, int, int, float* scratch)
+{
+    return scratch;
+}
+
+float* getFloatRowForWriting(Image* image, int y, int plane, float*)
+{
+    return image->getRowPointer(y, plane);
+}
+
+template<typename T>
+void storeFloatRow(const float* src, BasicImage<T>* image, int y, int plane, size_t count)
+{
+    std::transform(src, src + count, image->getRowPointer(y, plane), PixelTraits<T>::fromFloat);
+}
+
+void storeFloatRow(const float*, Image*, int, int, size_t)
+{
+}
+
+/*! Resizes 'image' into 'dst', which already has its final size, with a horizontal pass over the
+ *  source rows that the vertical pass needs and then the vertical pass. Both passes are split
+ *  into bands of rows that run on separate threads.
+ */
+template<typename T>
+void resampleSeparable(const BasicImage<T>& image, float fx, float fy, ResampleMode mode, BasicImage<T>* dst)
+{
+    const int width = image.getWidth();
+    const int height = image.getHeight();
+    const int newWidth = dst->getWidth();
+    const int newHeight = dst->getHeight();
+    if (width == 0 || height == 0 || newWidth == 0 || newHeight == 0 || image.getChannels() == 0) {
+        return;
+    }
+
+    // The rows of interleaved images and of every plane of planar images are consecutive pixels.
+    const bool planar = image.getPixelLayout() == PixelLayout::Planar;
+    const int planes = planar ? image.getChannels() : 1;
+    const int planeChannels = planar ? 1 : image.getChannels();
+    const size_t srcRowSize = static_cast<size_t>(width) * planeChannels;
+    const size_t dstRowSize = static_cast<size_t>(newWidth) * planeChannels;
+    if (srcRowSize > static_cast<size_t>(std::numeric_limits<int>::max())) {
+        throw std::invalid_argument("Rows are too long to resample.");
+    }
+
+    const detail::ResampleTable columns = computeResampleTable(width, newWidth, fx, mode);
+    std::vector<int> offsets;
+    std::vector<float> columnWeights;
+    detail::expandResampleTable(columns, planeChannels, &offsets, &columnWeights);
+
+    // Only the source rows that some output row reads are filtered horizontally.
+    const detail::ResampleTable rows = computeResampleTable(height, newHeight, fy, mode);
+    std::vector<int> neededRows;
+    std::vector<int> tmpRows(height, -1);
+    for (int y = 0; y < newHeight; ++y) {
+        for (int k = 0; k < rows.taps; ++k) {
+            const int row = rows.first[y] + k;
+            if (tmpRows[row] < 0) {
+                tmpRows[row] = static_cast<int>(neededRows.size());
+                neededRows.push_back(row);
+            }
+        }
+    }
+
+    AlignedBuffer<float> tmp;
+    tmp.resizeUninitialized(neededRows.size() * dstRowSize);
+    const int horizontalGrain = static_cast<int>(std::max<size_t>(kParallelElements / (dstRowSize * columns.taps), 1));
+    const int verticalGrain = static_cast<int>(std::max<size_t>(kParallelElements / (dstRowSize * rows.taps), 1));
+    for (int p = 0; p < planes; ++p) {
+        detail::parallelFor(0, static_cast<int>(neededRows.size()), horizontalGrain, [&](int begin, int end) {
+            std::vector<float> scratch(std::is_same<T, float>::value ? 0 : srcRowSize);
+            for (int i = begin; i < end; ++i) {
+                const float* src = getFloatRow(image, neededRows[i], p, srcRowSize, scratch.data());
+                detail::resampleSpan(src, offsets.data(), columnWeights.data(), columns.taps, planeChannels,
+                                     tmp.data() + i * dstRowSize, dstRowSize);
+            }
+        });
+
+        detail::parallelFor(0, newHeight, verticalGrain, [&](int begin, int end) {
+            std::vector<const float*> inputs(rows.taps);
+            std::vector<float> scratch(std::is_same<T, float>::value ? 0 : dstRowSize);
+            for (int y = begin; y < end; ++y) {
+                for (int k = 0; k < rows.taps; ++k) {
+                    inputs[k] = tmp.data() + tmpRows[rows.first[y] + k] * dstRowSize;
+                }
+                float* dstRow = getFloatRowForWriting(dst, y, p, scratch.data());
+                detail::weightedSumSpan(inputs.data(), rows.weights.data() + static_cast<size_t>(y) * rows.taps,
+                                        rows.taps, dstRow, dstRowSize);
+                storeFloatRow(dstRow, dst, y, p, dstRowSize);
+            }
+        });
+    }
+}
+
+/*! Resamples 'image' into 'dst', which gets the row padding and pixel layout of 'image'.
+ */
+template<typename T>
+void resampleImageInto(const BasicImage<T>& image, float fx, float fy, ResampleMode mode, BasicImage<T>* dst)
+{
+    const int newWidth = static_cast<int>(image.getWidth() / fx);
+    const int newHeight = static_cast<int>(image.getHeight() / fy);
+    dst->resizeImageUninitialized(newWidth, newHeight, image.getChannels(), image.getRowPadding(),
+                                  image.getPixelLayout());
+    if (mode != ResampleMode::Nearest) {
+        resampleSeparable(image, fx, fy, mode, dst);
+        return;
+    }
+
+    // Sample x * f of an integer factor is always inside the image so no clamping is needed.
+    const int factorX = static_cast<int>(fx);
+    const int factorY = static_cast<int>(fy);
+    if (factorX == fx && factorY == fy && factorX >= 1 && factorY >= 1) {
+        decimateImageView(image.getView(), dst->getView(), factorX, factorY);
+        return;
+    }
+
+    for (int y = 0; y < newHeight; ++y) {
+        for (int x = 0; x < newWidth; ++x) {
+            for (int c = 0; c < image.getChannels(); ++c) {
+                dst->setColor(image.getColor(x * fx, y * fy, c), x, y, c);
+            }
+        }
+    }
+}
+
+}
+
+template<typename T>
+BasicImage<T> resampleImage(const BasicImage<T>& image, float fx, float fy, ResampleMode mode)
+{
+    BasicImage<T> retImage;
+    resampleImageInto(image, fx, fy, mode, &retImage);
     return retImage;
 }
 
-void resampleImageInPlace(Image* image, float fx, float fy)
+template<typename T>
+void resampleImageInPlace(BasicImage<T>* image, float fx, float fy, ResampleMode mode)
 {
     assert(image != nullptr);
 
-    const int newWidth = static_cast<int>(image->getWidth() / fx);
-    const int newHeight = static_cast<int>(image->getHeight() / fy);
+    BasicImage<T> tmpImage;
+    resampleImageInto(*image, fx, fy, mode, &tmpImage);
+    *image = std::move(tmpImage);
+}
+
+namespace detail
+{
+
+template<typename T>
+void decimateImageView(const BasicImageView<const T>& src, const BasicImageView<T>& dst, int factorX, int factorY)
+{
+    assert(factorX >= 1 && factorY >= 1);
+    assert(static_cast<int64_t>(dst.getWidth()) * factorX <= src.getWidth() &&
+           static_cast<int64_t>(dst.getHeight()) * factorY <= src.getHeight() &&
+           dst.getChannels() == src.getChannels());
+    const int width = dst.getWidth();
+    const int channels = dst.getChannels();
+    if (width == 0 || channels == 0) {
+        return;
+    }
 
-    Image tmpImage(newWidth, newHeight, image->getChannels());
-    for (int y = 0; y < tmpImage.getHeight(); ++y) {
-        for (int x = 0; x < tmpImage.getWidth(); ++x) {
-            for (int c = 0; c < tmpImage.getChannels(); ++c) {
-                tmpImage.setColor(image->getColor(x * fx, y * fy, c),
-                                  x, y, c);
+    // Interleaved rows are decimated whole and everything else one channel at a time. Either
+    // way the span functions handle pixels of consecutive elements.
+    const bool interleaved = src.isInterleaved() && dst.isInterleaved();
+    const bool consecutive = interleaved || (src.getPixelStride() == 1 && dst.getPixelStride() == 1);
+    const int planes = interleaved ? 1 : channels;
+    const int spanChannels = interleaved ? channels : 1;
+    const size_t srcPixelStride = src.getPixelStride();
+    const size_t dstPixelStride = dst.getPixelStride();
+    const size_t rowSize = static_cast<size_t>(width) * spanChannels;
+    const int grain = static_cast<int>(std::max<size_t>(kParallelElements / (rowSize * planes), 1));
+    parallelFor(0, dst.getHeight(), grain, [&](int begin, int end) {
+        for (int p = 0; p < planes; ++p) {
+            for (int y = begin; y < end; ++y) {
+                const T* srcRow = src.getRowPointer(y * factorY, p);
+                T* dstRow = dst.getRowPointer(y, p);
+                if (consecutive) {
+                    decimateSpan(srcRow, dstRow, width, spanChannels, factorX);
+                } else {
+                    for (int x = 0; x < width; ++x) {
+                        dstRow[x * dstPixelStride] = srcRow[static_cast<size_t>(x) * factorX * srcPixelStride];
+                    }
+                }
             }
         }
+    });
+}
+
+}
+
+template<typename T>
+BasicImage<T> convertPixelLayout(const BasicImage<T>& image, PixelLayout layout)
+{
+    if (image.getPixelLayout() == layout) {
+        return image;
     }
+    return BasicImage<T>(image.getView(), image.getRowPadding(), layout);
+}
 
-    *image = std::move(tmpImage);
+void copyImageView(const ConstImageView& src, const ImageView& dst)
+{
+    convertImageView(src, dst);
 }
 
+template class BasicImage<float>;
+template class BasicImage<half>;
+template class BasicImage<uint8_t>;
+template class BasicImage<uint16_t>;
+
+template Image resampleImage(const Image&, float, float, ResampleMode);
+template Image8 resampleImage(const Image8&, float, float, ResampleMode);
+template Image16 resampleImage(const Image16&, float, float, ResampleMode);
+template ImageHalf resampleImage(const ImageHalf&, float, float, ResampleMode);
+
+template void resampleImageInPlace(Image*, float, float, ResampleMode);
+template void resampleImageInPlace(Image8*, float, float, ResampleMode);
+template void resampleImageInPlace(Image16*, float, float, ResampleMode);
+template void resampleImageInPlace(ImageHalf*, float, float, ResampleMode);
+
+template void detail::decimateImageView(const ConstImageView&, const ImageView&, int, int);
+template void detail::decimateImageView(const BasicImageView<const uint8_t>&, const BasicImageView<uint8_t>&, int, int);
+template void detail::decimateImageView(const BasicImageView<const uint16_t>&, const BasicImageView<uint16_t>&, int,
+                                        int);
+template void detail::decimateImageView(const BasicImageView<const half>&, const BasicImageView<half>&, int, int);
+
+template void streamImageFromFile(const std::string&, const std::function<void(const ConstImageView&, int)>&);
+template void streamImageFromFile(const std::string&,
+                                  const std::function<void(const BasicImageView<const half>&, int)>&);
+template void streamImageFromFile(const std::string&,
+                                  const std::function<void(const BasicImageView<const uint8_t>&, int)>&);
+template void streamImageFromFile(const std::string&,
+                                  const std::function<void(const BasicImageView<const uint16_t>&, int)>&);
+
+template Image convertPixelLayout(const Image&, PixelLayout);
+template Image8 convertPixelLayout(const Image8&, PixelLayout);
+template Image16 convertPixelLayout(const Image16&, PixelLayout);
+template ImageHalf convertPixelLayout(const ImageHalf&, PixelLayout);
+
 }
@@ -3,11 +3,22 @@
 // found in the LICENSE file. The SIFT algorithm is
 // patented and its use for commercial applications must be licensed.
 // See the LICENSE file for details.
+#pragma once
+
+#include "aligned_buffer.h"
+#include "image_expression.h"
+#include "image_layout.h"
+#include "image_view.h"
+#include "pixel_type.h"
 #include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <sstream>
 #include <string>
 #include <stdexcept>
-#include <vector>
+#include <type_traits>
 
 namespace sift
 {
@@ -25,92 +36,222 @@ public:
     const char* what() const throw() override;
 };
 
-/*! \brief Called 'Image' but in effect is can represent any 3D floating point data.
+/*! \brief How BasicImage::loadFromFileAsGrayscale weights the red, green and blue channels.
  *
- *  Stores a tensor of size (width, height, channels). Provides functionality to load in an image
- *  OpenImageIO.
+ *  The default is the Rec. 709 luma, which is what the sRGB primaries call for. Use e.g.
+ *  (0.299, 0.587, 0.114) for the Rec. 601 luma. The weights usually sum to 1 so that white stays 1.
  */
-class Image
+struct GrayscaleWeights
+{
+    GrayscaleWeights():
+        red(0.2126f),
+        green(0.7152f),
+        blue(0.0722f)
+    {}
+
+    GrayscaleWeights(float red, float green, float blue):
+        red(red),
+        green(green),
+        blue(blue)
+    {}
+
+    float red;
+    float green;
+    float blue;
+};
+
+/*! \brief Called 'Image' but in effect is can represent any 3D data.
+ *
+ *  Stores a tensor of size (width, height, channels) of pixels of type T, which is one of float,
+ *  half, uint8_t and uint16_t (see PixelTraits). The filters work on Image, i.e. BasicImage<float>,
+ *  and integer and half images are mostly meant to keep decoded inputs small. They are converted
+ *  to float row by row by the first filter that reads them.
+ *  Provides functionality to load in an image OpenImageIO. Float images can be combined
+ *  element-wise with +, - and scalar * (see ImageExpression).
+ *  Element (x, y, c) is stored at getData()[getBufferIndex(x, y, c)] with getBufferIndex(x, y, c) =
+ *  x * getPixelStride() + y * getStride() + c * getChannelStride(), which covers both pixel layouts.
+ *  The data is aligned to 64 bytes.
+ *
+ *  An image can have a halo (see setHalo): a border of extra pixels around every channel that
+ *  holds copies of the edge pixels, so that neighborhood kernels can read past the edges without
+ *  clamping. The halo is part of the allocation but not of the image, i.e. width, height, views,
+ *  comparisons and expressions only cover the pixels inside of it.
+ */
+template<typename T>
+class BasicImage: public ImageExpression<BasicImage<T>>
 {
 public:
+    /*! The type of the pixels.
+     */
+    typedef T PixelType;
+
+    /*! A view that allows the pixels to be modified.
+     */
+    typedef BasicImageView<T> View;
+
+    /*! A view that only allows the pixels to be read.
+     */
+    typedef BasicImageView<const T> ConstView;
+
     /*! Creates an empty image that has zero pixels in it.
      */
-    Image();
+    BasicImage();
 
-    Image(const Image& other) = default;
-    Image& operator=(const Image& other) = default;
+    BasicImage(const BasicImage& other) = default;
+    BasicImage& operator=(const BasicImage& other) = default;
 
-    Image(Image&& other) = default;
-    Image& operator=(Image&& other) = default;
+    BasicImage(BasicImage&& other) = default;
+    BasicImage& operator=(BasicImage&& other) = default;
 
     /*! Allocates memory for an image that is of size (width, height) the specified
-     *  number of channels.
+     *  number of channels. All elements are zero.
      *  @param[in] width Width of the image.
      *  @param[in] height Height of the image.
      *  @param[in] channels Number of image color channels.
+     *  @param[in] padding How the rows are laid out in memory.
+     *  @param[in] layout How the channels are laid out in memory.
+     */
+    BasicImage(const int width, const int height, const int channels, const RowPadding padding = RowPadding::None,
+          const PixelLayout layout = PixelLayout::Interleaved);
+
+    /*! Copies the pixels of a view into a new image.
+     *  @param[in] view The pixels to copy. Can have any strides.
+     *  @param[in] padding How the rows are laid out in memory.
+     *  @param[in] layout How the channels are laid out in memory.
      */
-    Image(const int width, const int height, const int channels);
+    explicit BasicImage(const ConstView& view, const RowPadding padding = RowPadding::None,
+                   const PixelLayout layout = PixelLayout::Interleaved);
 
-    /*! Resizes the buffer to contain the specified amount of data.
+    /*! Evaluates an element-wise expression into a new image that has the layout of its operands.
+     *  @param[in] expression Expression such as 'a + b - c' built from images of the same size.
+     */
+    template<typename Expression>
+    BasicImage(const ImageExpression<Expression>& expression);
+
+    /*! Evaluates an element-wise expression into this image in a single pass. The expression
+     *  may refer to this image itself.
+     *  @param[in] expression Expression such as 'a + b - c' built from images of the same size.
+     *  @return Self.
+     */
+    template<typename Expression>
+    BasicImage& operator=(const ImageExpression<Expression>& expression);
+
+    /*! Resizes the buffer to contain the specified amount of data and keeps the row padding,
+     *  pixel layout and halo width.
+     *  The contents are only kept if the size of the buffer does not change, otherwise all
+     *  elements are zero.
      *  @param[in] width Width of the image.
      *  @param[in] height Height of the image.
      *  @param[in] channels Number of image color channels.
      */
     void resizeImage(const int width, const int height, const int channels);
 
-    /*! Loads an image from the given filename.
+    /*! Resizes the buffer to contain the specified amount of data with the given row padding.
+     *  Keeps the pixel layout.
+     *  @param[in] width Width of the image.
+     *  @param[in] height Height of the image.
+     *  @param[in] channels Number of image color channels.
+     *  @param[in] padding How the rows are laid out in memory.
+     */
+    void resizeImage(const int width, const int height, const int channels, const RowPadding padding);
+
+    /*! Resizes the buffer to contain the specified amount of data with the given row padding and
+     *  pixel layout.
+     *  @param[in] width Width of the image.
+     *  @param[in] height Height of the image.
+     *  @param[in] channels Number of image color channels.
+     *  @param[in] padding How the rows are laid out in memory.
+     *  @param[in] layout How the channels are laid out in memory.
+     */
+    void resizeImage(const int width, const int height, const int channels, const RowPadding padding,
+                     const PixelLayout layout);
+
+    /*! Same as resizeImage but leaves the elements, halo included, uninitialized. Meant for images
+     *  that are about to be overwritten completely, where zero filling them first would only cost
+     *  an extra pass over the memory. The buffer is reused if it is large enough, so shrinking and
+     *  growing back within the capacity does not allocate.
+     *  @param[in] width Width of the image.
+     *  @param[in] height Height of the image.
+     *  @param[in] channels Number of image color channels.
+     */
+    void resizeImageUninitialized(const int width, const int height, const int channels);
+
+    /*! Same as resizeImage but leaves the elements, halo included, uninitialized.
+     *  @param[in] width Width of the image.
+     *  @param[in] height Height of the image.
+     *  @param[in] channels Number of image color channels.
+     *  @param[in] padding How the rows are laid out in memory.
+     *  @param[in] layout How the channels are laid out in memory.
+     */
+    void resizeImageUninitialized(const int width, const int height, const int channels, const RowPadding padding,
+                                  const PixelLayout layout);
+
+    /*! Loads an image from the given filename into the current row padding, pixel layout and halo.
+     *  The file is decoded a few scanlines or a row of tiles at a time straight into the image, so
+     *  loading only needs one such band of memory on top of the image. Planar images are split into
+     *  planes band by band. Throws ImageIOException if the file cannot be opened or decoded.
      *  @param[in] fname The filename to load an image from. Must be a format that
      *                   OpenImageIO supports.
      */
     void loadFromFile(const std::string& fname);
 
+    /*! Loads an image from the given filename into the given pixel layout.
+     *  @param[in] fname The filename to load an image from. Must be a format that
+     *                   OpenImageIO supports.
+     *  @param[in] layout How the channels are laid out in memory.
+     */
+    void loadFromFile(const std::string& fname, const PixelLayout layout);
+
+    /*! Loads an image from the given filename as a single channel of luminance. Every decoded
+     *  scanline is converted before the next one is read, so the color image is never stored and
+     *  the filters only have a third of the channels to work on. Files with one or two channels
+     *  are gray, optionally with alpha, and their first channel is loaded as is. Otherwise the first
+     *  three channels are red, green and blue, and any further channel like alpha is ignored.
+     *  The current row padding, pixel layout and halo are kept.
+     *  @param[in] fname The filename to load an image from. Must be a format that
+     *                   OpenImageIO supports.
+     *  @param[in] weights How much red, green and blue contribute to the luminance.
+     */
+    void loadFromFileAsGrayscale(const std::string& fname, const GrayscaleWeights& weights = GrayscaleWeights());
+
     /*! Saves the stored image to the given filename.
      * @param[in] fname The filename to save the image to. Must be a format that
      *                  OpenImageIO support.
      */
     void saveToFile(const std::string& fname) const;
 
-    /*! Checks for equality in size and data between the two images.
+    /*! Checks for equality in size and data between the two images. The layout in memory is
+     *  not compared.
      * @param[in] rhs Other image to compare to.
      * @return True if all members are equivalent. False otherwise.
      */
-    bool operator==(const Image& rhs) const;
+    bool operator==(const BasicImage& rhs) const;
 
     /*! Checks for inequality in size and data between the two images.
      * @param[in] rhs Other image to compare to.
      * @return True if all members are different. False otherwise.
      */
-    bool operator!=(const Image& rhs) const;
+    bool operator!=(const BasicImage& rhs) const;
 
     /*! Add images element-wise.
-     * @param[in] rhs Image to perform the operation with.
-     *  @return A new image that where each data element has an addition operation performed.
-     */
-    Image operator+(const Image& rhs) const;
-
-    /*! Add images element-wise.
-     * @param[in] rhs Image to perform the operation with.
+     * @param[in] rhs Image to perform the operation with. Must have the same pixel layout.
      * @return Self.
      */
-    Image& operator+=(const Image& rhs);
-
-    /*! Subtract images element-wise.
-     *  @param[in] rhs Image to perform the operation with.
-     *  @return A new image that where each data element has a subtraction operation performed.
-     */
-    inline Image operator-(const Image& rhs) const { return *this + (-rhs); }
+    BasicImage& operator+=(const BasicImage& rhs);
 
-    /*! Negates the data buffer.
-     *  @return An image with each data element being negated.
+    /*! Add an expression element-wise.
+     * @param[in] rhs Expression to perform the operation with.
+     * @return Self.
      */
-    Image operator-() const;
+    template<typename Expression>
+    BasicImage& operator+=(const ImageExpression<Expression>& rhs);
 
-    /*! Subtract images element-wise.
-     * @param[in] rhs Image to perform the operation with.
+    /*! Subtract an image or expression element-wise.
+     * @param[in] rhs Image or expression to perform the operation with.
      * @return Self.
      */
-    Image& operator-=(const Image& rhs);
-
+    template<typename Expression>
+    BasicImage& operator-=(const ImageExpression<Expression>& rhs);
 
     /*! Retrieves width of image.
      * @return Width of the image in pixels.
@@ -128,17 +269,145 @@ public:
     int getChannels() const { return _channels; }
 
     /*! Retrieves the size of the data buffer.
-     * @return Size of the data buffer in bytes.
+     * @return Number of elements in the data buffer, including the row padding and the halo.
      */
     size_t getBufferSize() const { return _data.size(); }
 
-    /*! Retrieves data from the stored data.
+    /*! Retrieves how the rows are laid out in memory.
+     * @return The row padding the image was created with.
+     */
+    RowPadding getRowPadding() const { return _padding; }
+
+    /*! Retrieves how the channels are laid out in memory.
+     * @return The pixel layout the image was created with.
+     */
+    PixelLayout getPixelLayout() const { return _layout; }
+
+    /*! Retrieves the distance between the starts of two consecutive rows of a channel.
+     * @return Row stride in elements. At least width * getPixelStride().
+     */
+    size_t getStride() const { return _stride; }
+
+    /*! Retrieves the distance between two horizontally adjacent elements of a channel.
+     * @return The number of channels for interleaved images and 1 for planar images.
+     */
+    size_t getPixelStride() const { return (_layout == PixelLayout::Planar) ? 1 : static_cast<size_t>(_channels); }
+
+    /*! Retrieves the distance between two channels of a pixel.
+     * @return 1 for interleaved images and the size of a plane for planar images.
+     */
+    size_t getChannelStride() const
+    {
+        return (_layout == PixelLayout::Planar) ? _stride * (static_cast<size_t>(_height) + 2 * _halo) : 1;
+    }
+
+    /*! Retrieves the width of the halo.
+     * @return Number of extra pixels on each side of every row and extra rows above and below every channel.
+     */
+    int getHalo() const { return _halo; }
+
+    /*! Retrieves how the halo is filled.
+     * @return The border mode that fillHalo uses.
+     */
+    BorderMode getBorderMode() const { return _border; }
+
+    /*! Gives the image a halo and fills it. The pixels are kept.
+     * @param[in] halo Number of extra pixels on each side of every row and extra rows above and
+     *                 below every channel. Kept when the image is resized.
+     * @param[in] border How the halo is filled from the edges of the image.
+     */
+    void setHalo(const int halo, const BorderMode border = BorderMode::Replicate);
+
+    /*! Fills the halo from the edges of the image. Has to be called again after the pixels at the
+     *  edges change, which includes resizing and assigning expressions.
+     */
+    void fillHalo();
+
+    /*! Retrieves the underlying data buffer. Elements are laid out in the order
+     *  given by getBufferIndex.
+     * @return Pointer to element (0, 0, 0). Only the start of the buffer if there is no halo.
+     */
+    T* getData() { return _data.data() + _origin; }
+
+    /*! Retrieves the underlying data buffer. Elements are laid out in the order
+     *  given by getBufferIndex.
+     * @return Pointer to element (0, 0, 0). Only the start of the buffer if there is no halo.
+     */
+    const T* getData() const { return _data.data() + _origin; }
+
+    /*! Retrieves the first element of a row of a channel. Element x of the row is
+     *  getPixelStride() * x elements further. For interleaved images the row of channel 0 holds
+     *  all width * channels elements of the row.
+     * @param[in] y The row to query. Can be in the halo.
+     * @param[in] channel The channel to query.
+     * @return Pointer to element (0, y, channel).
+     */
+    T* getRowPointer(int y, int channel = 0)
+    {
+        return getData() + static_cast<ptrdiff_t>(y) * static_cast<ptrdiff_t>(_stride) +
+               static_cast<size_t>(channel) * getChannelStride();
+    }
+
+    /*! Retrieves the first element of a row of a channel. Element x of the row is
+     *  getPixelStride() * x elements further. For interleaved images the row of channel 0 holds
+     *  all width * channels elements of the row.
+     * @param[in] y The row to query. Can be in the halo.
+     * @param[in] channel The channel to query.
+     * @return Pointer to element (0, y, channel).
+     */
+    const T* getRowPointer(int y, int channel = 0) const
+    {
+        return getData() + static_cast<ptrdiff_t>(y) * static_cast<ptrdiff_t>(_stride) +
+               static_cast<size_t>(channel) * getChannelStride();
+    }
+
+    /*! Creates a view of all pixels that can be used to modify them.
+     * @return A view that is valid until the image is resized or destroyed.
+     */
+    View getView()
+    {
+        return View(getData(), _width, _height, _channels, _stride, getPixelStride(), getChannelStride());
+    }
+
+    /*! Creates a read-only view of all pixels.
+     * @return A view that is valid until the image is resized or destroyed.
+     */
+    ConstView getView() const
+    {
+        return ConstView(getData(), _width, _height, _channels, _stride, getPixelStride(), getChannelStride());
+    }
+
+    /*! Lets an image be passed wherever a view is expected.
+     */
+    operator View() { return getView(); }
+    operator ConstView() const { return getView(); }
+
+    /*! Computes the row stride an image with the given size, padding and layout has.
+     * @param[in] width Width of the image.
+     * @param[in] channels Number of image color channels.
+     * @param[in] padding How the rows are laid out in memory.
+     * @param[in] layout How the channels are laid out in memory.
+     * @return Row stride in elements.
+     */
+    static size_t computeStride(int width, int channels, RowPadding padding,
+                                PixelLayout layout = PixelLayout::Interleaved);
+
+    /*! Retrieves data from the stored data. Coordinates outside of the image are clamped to the
+     *  closest edge pixel, which makes this too slow for inner loops.
      * @param x The column of the image to query.
      * @param y The row of the image to query.
      * @param channel Which color channel to query.
      * @return The element in the _data member indexed by x, y, and channel.
      */
-    float getColor(int x, int y, int channel) const;
+    T getColor(int x, int y, int channel) const;
+
+    /*! Retrieves data from the stored data without clamping.
+     * @param x The column of the image to query. Must be in [-getHalo(), width + getHalo()).
+     * @param y The row of the image to query. Must be in [-getHalo(), height + getHalo()).
+     * @param channel Which color channel to query.
+     * @return The element indexed by x, y, and channel, which is a halo element outside of the image.
+     */
+    T getColorUnclamped(int x, int y, int channel) const;
 
     /*! Sets data into the underlying buffer.
      * @param[in] value The value to set in the buffer.
@@ -146,7 +415,7 @@ public:
      * @param[in] y The row of the image to set.
      * @param[in] channel Which color channel to set.
      */
-    void setColor(float value, int x, int y, int channel);
+    void setColor(T value, int x, int y, int channel);
 
     /*! Retrieves data from the stored data but casted to a byte. Conversion is done by
      *  multiplying by 255 and clamping to be between 0 and 255.
@@ -163,15 +432,31 @@ protected:
      * @param x The column of the image to query.
      * @param y The row of the image to query.
      * @param channel Which color channel to query.
-     * @return The sequential index into the buffer to for (x, y, channel).
+     * @return The index of (x, y, channel) relative to getData(). Negative in the halo.
+     */
+    ptrdiff_t getBufferIndex(int x, int y, int channel) const;
+
+    /*! Rounds a row size up to the given padding.
+     * @param[in] avoidAliasing Whether to add a cache line to multiples of 4096 bytes.
      */
-    int getBufferIndex(int x, int y, int channel) const;
+    static size_t padRowSize(size_t rowSize, RowPadding padding, bool avoidAliasing);
 
 private:
-    std::vector<float> _data; 
+    /*! Computes the layout of the buffer and resizes it.
+     *  @param[in] zeroFill Whether to set all elements to zero. Otherwise they are uninitialized.
+     */
+    void resizeBuffer(int width, int height, int channels, RowPadding padding, PixelLayout layout, bool zeroFill);
+
+    AlignedBuffer<T> _data;
+    size_t _origin;
+    size_t _stride;
     int _width;
     int _height;
     int _channels;
+    int _halo;
+    RowPadding _padding;
+    PixelLayout _layout;
+    BorderMode _border;
 };
 
 inline const char* ImageIOException::what() const throw()
@@ -181,55 +466,253 @@ inline const char* ImageIOException::what() const throw()
     return buff.str().c_str();
 }
 
-inline bool Image::operator!=(const Image& rhs) const
+template<typename T>
+inline bool BasicImage<T>::operator!=(const BasicImage& rhs) const
 {
     return !(*this == rhs);
 }
 
-inline Image Image::operator+(const Image& rhs) const
+inline ImageOperand::ImageOperand(const Image& image):
+    _view(image.getView()), _layout(image.getPixelLayout())
 {
-    Image retImage(*this);
-    retImage += rhs;
-    return retImage;
 }
 
-inline Image& Image::operator-=(const Image& rhs)
+template<typename T>
+template<typename Expression>
+BasicImage<T>::BasicImage(const ImageExpression<Expression>& expression):
+    _origin(0), _stride(0), _width(0), _height(0), _channels(0), _halo(0),
+    _padding(RowPadding::None), _layout(PixelLayout::Interleaved), _border(BorderMode::Replicate)
+{
+    *this = expression;
+}
+
+template<typename T>
+template<typename Expression>
+BasicImage<T>& BasicImage<T>::operator=(const ImageExpression<Expression>& expression)
 {
-    *this += (-rhs);
+    static_assert(std::is_same<T, float>::value, "Only float images can be used in expressions.");
+
+    // Every element only depends on the elements at the same index so writing into an
+    // image that is also an operand is fine. Such an image already has the right size and layout.
+    const typename ImageExpressionTraits<Expression>::OperandType operand(expression.derived());
+    if (_width != operand.getWidth() || _height != operand.getHeight() || _channels != operand.getChannels() ||
+        _layout != operand.getPixelLayout()) {
+        resizeImageUninitialized(operand.getWidth(), operand.getHeight(), operand.getChannels(), _padding,
+                                 operand.getPixelLayout());
+    }
+
+    detail::evaluateImageExpression(operand, getView());
     return *this;
 }
 
-inline int Image::getBufferIndex(int x, int y, int channel) const
+template<typename T>
+template<typename Expression>
+BasicImage<T>& BasicImage<T>::operator+=(const ImageExpression<Expression>& rhs)
+{
+    return *this = *this + rhs;
+}
+
+template<typename T>
+template<typename Expression>
+BasicImage<T>& BasicImage<T>::operator-=(const ImageExpression<Expression>& rhs)
+{
+    return *this = *this - rhs;
+}
+
+template<typename T>
+inline ptrdiff_t BasicImage<T>::getBufferIndex(int x, int y, int channel) const
 {
-    return channel + x * _channels + y * _channels * _width;
+    // Images can have more than 2^31 elements so the index is computed in ptrdiff_t, which costs
+    // the same as int on 64-bit targets.
+    return static_cast<ptrdiff_t>(channel) * static_cast<ptrdiff_t>(getChannelStride()) +
+           static_cast<ptrdiff_t>(x) * static_cast<ptrdiff_t>(getPixelStride()) +
+           static_cast<ptrdiff_t>(y) * static_cast<ptrdiff_t>(_stride);
 }
 
-inline float Image::getColor(int x, int y, int channel) const
+template<typename T>
+inline T BasicImage<T>::getColor(int x, int y, int channel) const
 {
     // Clamp at the edge.
-    x = std::min(std::max(x, 0), getWidth());
-    y = std::min(std::max(y, 0), getHeight());
-    return _data[getBufferIndex(x, y, channel)];
+    x = std::min(std::max(x, 0), getWidth() - 1);
+    y = std::min(std::max(y, 0), getHeight() - 1);
+    return getData()[getBufferIndex(x, y, channel)];
+}
+
+template<typename T>
+inline T BasicImage<T>::getColorUnclamped(int x, int y, int channel) const
+{
+    assert(x >= -_halo && x < _width + _halo && y >= -_halo && y < _height + _halo);
+    return getData()[getBufferIndex(x, y, channel)];
 }
 
-inline void Image::setColor(float value, int x, int y, int channel)
+template<typename T>
+inline void BasicImage<T>::setColor(T value, int x, int y, int channel)
 {
-    _data[getBufferIndex(x, y, channel)] = value;
+    getData()[getBufferIndex(x, y, channel)] = value;
 }
 
-inline unsigned char Image::getCastedColor(int x, int y, int channel) const
+namespace detail
 {
-    const float data = std::min(std::max(255.f * getColor(x, y, channel), 0.0f), 255.0f);
+
+/*! Converts a pixel to a byte the way getCastedColor describes. Bytes are returned as they are.
+ */
+template<typename T>
+unsigned char castPixelToByte(T value)
+{
+    const float data = std::min(std::max(255.f * PixelTraits<T>::toFloat(value), 0.0f), 255.0f);
     return static_cast<unsigned char>(data);
 }
 
-/*! Performs a naive resample of the image.
+inline unsigned char castPixelToByte(uint8_t value)
+{
+    return value;
+}
+
+}
+
+template<typename T>
+inline unsigned char BasicImage<T>::getCastedColor(int x, int y, int channel) const
+{
+    return detail::castPixelToByte(getColor(x, y, channel));
+}
+
+extern template class BasicImage<float>;
+extern template class BasicImage<half>;
+extern template class BasicImage<uint8_t>;
+extern template class BasicImage<uint16_t>;
+
+/*! Decodes an image file a band of rows at a time without storing all of it, e.g. to process
+ *  images that do not fit into memory. A band is a row of tiles for tiled files and a few
+ *  scanlines otherwise, and it is the only memory decoding needs. Throws ImageIOException if the
+ *  file cannot be opened or decoded.
+ *  @param[in] fname The filename to decode. Must be a format that OpenImageIO supports.
+ *  @param[in] consumer Called with every band from top to bottom as consumer(rows, y), where 'rows'
+ *                      is a packed interleaved view of rows y to y + rows.getHeight() - 1 of the
+ *                      image with all channels. The view is only valid during the call.
+ */
+template<typename T>
+void streamImageFromFile(const std::string& fname,
+                         const std::function<void(const BasicImageView<const T>& rows, int y)>& consumer);
+
+/*! An image with 8 bits per element, which is how most image files store their pixels.
+ */
+typedef BasicImage<uint8_t> Image8;
+
+/*! An image with 16 bits per element.
+ */
+typedef BasicImage<uint16_t> Image16;
+
+/*! An image of 16-bit floats. Half the size of an Image at about three significant digits.
+ */
+typedef BasicImage<half> ImageHalf;
+
+/*! Resamples the image to (width / fx) x (height / fy) pixels, rounded down. The default samples
+ *  every fx columns and fy rows and goes through decimateImageView for integer factors. The other
+ *  modes filter the image with one horizontal and one vertical pass that use precomputed tables of
+ *  weights and run on several threads for large images (see setThreadCount).
  *  @param[in] image Image to resample.
- *  @param[in] fx Gets every fx columns.
- *  @param[in] fy Gets every fy rows.
- *  @return The resampled image.
+ *  @param[in] fx Horizontal factor. Values above 1 shrink the image.
+ *  @param[in] fy Vertical factor. Values above 1 shrink the image.
+ *  @param[in] mode How the pixels of the resampled image are computed.
+ *  @return The resampled image. It has the row padding and pixel layout of 'image' but no halo.
  */
-Image resampleImage(const Image& image, float fx, float fy);
-void resampleImageInPlace(Image* image, float fx, float fy);
+template<typename T>
+BasicImage<T> resampleImage(const BasicImage<T>& image, float fx, float fy,
+                            ResampleMode mode = ResampleMode::Nearest);
+template<typename T>
+void resampleImageInPlace(BasicImage<T>* image, float fx, float fy, ResampleMode mode = ResampleMode::Nearest);
+
+namespace detail
+{
+
+template<typename T>
+void decimateImageView(const BasicImageView<const T>& src, const BasicImageView<T>& dst, int factorX, int factorY);
+
+}
+
+/*! Keeps every factorX-th pixel of every factorY-th row, starting from the first, like
+ *  resampleImage does for integer factors. Decimating float pixels by 2 horizontally, which is
+ *  what the pyramid does, uses the vector kernels. Large images are split into bands of rows that
+ *  are decimated on separate threads (see setThreadCount).
+ *  @param[in] src The pixels to decimate.
+ *  @param[in] dst Receives the kept pixels. Must have the pixel type and channels of 'src', at most
+ *                 src.getWidth() / factorX columns and src.getHeight() / factorY rows, and must
+ *                 not overlap 'src'.
+ *  @param[in] factorX Distance between two kept columns.
+ *  @param[in] factorY Distance between two kept rows.
+ */
+template<typename Src, typename Dst>
+void decimateImageView(const BasicImageView<Src>& src, const BasicImageView<Dst>& dst, int factorX, int factorY)
+{
+    static_assert(std::is_same<typename std::remove_const<Src>::type, Dst>::value,
+                  "Decimation does not convert pixel types.");
+    detail::decimateImageView(BasicImageView<const Dst>(src), dst, factorX, factorY);
+}
+
+/*! Copies an image into another pixel layout. The row padding is kept.
+ *  @param[in] image Image to convert.
+ *  @param[in] layout The pixel layout of the copy.
+ *  @return An image with the same elements as 'image' and the given layout.
+ */
+template<typename T>
+BasicImage<T> convertPixelLayout(const BasicImage<T>& image, PixelLayout layout);
+
+/*! Copies the pixels of one view into another of the same size. The views may have different
+ *  strides but must not overlap.
+ *  @param[in] src The pixels to copy.
+ *  @param[in] dst Where to copy the pixels to.
+ */
+void copyImageView(const ConstImageView& src, const ImageView& dst);
+
+/*! Copies the pixels of one view into another of the same size and converts them to the pixel
+ *  type of 'dst' (see PixelTraits). The views may have different strides but must not overlap.
+ *  @param[in] src The pixels to convert.
+ *  @param[in] dst Where to store the converted pixels.
+ */
+template<typename Src, typename Dst>
+void convertImageView(const BasicImageView<Src>& src, const BasicImageView<Dst>& dst)
+{
+    typedef typename std::remove_const<Src>::type SrcPixel;
+    assert(src.getWidth() == dst.getWidth() && src.getHeight() == dst.getHeight() &&
+           src.getChannels() == dst.getChannels());
+    const int width = src.getWidth();
+    if (src.isInterleaved() && dst.isInterleaved()) {
+        const size_t rowSize = static_cast<size_t>(width) * src.getChannels();
+        for (int y = 0; y < src.getHeight(); ++y) {
+            const Src* srcRow = src.getRowPointer(y);
+            std::transform(srcRow, srcRow + rowSize, dst.getRowPointer(y), convertPixel<Dst, SrcPixel>);
+        }
+        return;
+    }
+
+    const size_t srcPixelStride = src.getPixelStride();
+    const size_t dstPixelStride = dst.getPixelStride();
+    for (int c = 0; c < src.getChannels(); ++c) {
+        for (int y = 0; y < src.getHeight(); ++y) {
+            const Src* srcRow = src.getRowPointer(y, c);
+            Dst* dstRow = dst.getRowPointer(y, c);
+            for (int x = 0; x < width; ++x) {
+                dstRow[x * dstPixelStride] = convertPixel<Dst, SrcPixel>(srcRow[x * srcPixelStride]);
+            }
+        }
+    }
+}
+
+/*! Copies an image into another pixel type. The row padding, pixel layout and halo are kept.
+ *  @param[in] image Image to convert.
+ *  @return An image whose elements are the elements of 'image' converted with convertPixel.
+ */
+template<typename Dst, typename Src>
+BasicImage<Dst> convertPixelType(const BasicImage<Src>& image)
+{
+    BasicImage<Dst> retImage;
+    retImage.resizeImageUninitialized(image.getWidth(), image.getHeight(), image.getChannels(), image.getRowPadding(),
+                                      image.getPixelLayout());
+    convertImageView(image.getView(), retImage.getView());
+    if (image.getHalo() > 0) {
+        retImage.setHalo(image.getHalo(), image.getBorderMode());
+    }
+    return retImage;
+}
 
 }
@@ -0,0 +1,270 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#pragma once
+
+#include "image_layout.h"
+#include "image_view.h"
+#include <cassert>
+#include <cstddef>
+
+namespace sift
+{
+
+template<typename T>
+class BasicImage;
+
+/*! The image type all filters work with. See BasicImage.
+ */
+typedef BasicImage<float> Image;
+
+/*! \brief Base class of everything that can appear in an element-wise image expression.
+ *
+ *  Arithmetic operators on images do not compute anything. They build a small tree of expression
+ *  objects that is evaluated in a single loop once it is assigned to an Image, so that something
+ *  like 'a + b - c' reads every input once and never creates a temporary image.
+ *  Expressions refer to the images they were built from so they must be evaluated before those
+ *  images go away, i.e. do not store them in 'auto' variables.
+ *  Every expression provides getWidth(), getHeight(), getChannels(), getPixelLayout() and
+ *  operator()(y, i), which evaluates element i of row y of the memory the expression covers (see
+ *  detail::getExpressionRows). All images in an expression must have the same pixel layout.
+ */
+template<typename Derived>
+class ImageExpression
+{
+public:
+    const Derived& derived() const { return static_cast<const Derived&>(*this); }
+};
+
+namespace detail
+{
+
+/*! Finds a row of the rows an expression is evaluated in (see getExpressionRows).
+ *  @param[in] view The pixels of an image with the given layout.
+ *  @param[in] layout The pixel layout of the image.
+ *  @param[in] row The row to find.
+ *  @return Pointer to the first element of the row.
+ */
+template<typename T>
+T* getExpressionRowPointer(const BasicImageView<T>& view, PixelLayout layout, int row)
+{
+    if (layout == PixelLayout::Planar) {
+        return view.getRowPointer(row % view.getHeight(), row / view.getHeight());
+    }
+    return view.getRowPointer(row);
+}
+
+}
+
+/*! \brief A leaf of an expression that reads the data of an Image.
+ */
+class ImageOperand: public ImageExpression<ImageOperand>
+{
+public:
+    explicit ImageOperand(const Image& image);
+
+    int getWidth() const { return _view.getWidth(); }
+    int getHeight() const { return _view.getHeight(); }
+    int getChannels() const { return _view.getChannels(); }
+    PixelLayout getPixelLayout() const { return _layout; }
+    const ConstImageView& getView() const { return _view; }
+    const float* getRowPointer(int y) const { return detail::getExpressionRowPointer(_view, _layout, y); }
+    float operator()(int y, size_t i) const { return getRowPointer(y)[i]; }
+
+private:
+    ConstImageView _view;
+    PixelLayout _layout;
+};
+
+/*! Maps the type of a node to how it is stored inside of its parent. Images are stored as
+ *  ImageOperands and every other expression by value.
+ */
+template<typename T>
+struct ImageExpressionTraits
+{
+    typedef T OperandType;
+};
+
+template<>
+struct ImageExpressionTraits<Image>
+{
+    typedef ImageOperand OperandType;
+};
+
+namespace detail
+{
+
+struct AddOperation
+{
+    static float apply(float lhs, float rhs) { return lhs + rhs; }
+};
+
+struct SubtractOperation
+{
+    static float apply(float lhs, float rhs) { return lhs - rhs; }
+};
+
+}
+
+/*! \brief Applies 'Operation' to the corresponding elements of two expressions of the same size.
+ */
+template<typename Operation, typename Lhs, typename Rhs>
+class BinaryImageExpression: public ImageExpression<BinaryImageExpression<Operation, Lhs, Rhs>>
+{
+public:
+    BinaryImageExpression(const Lhs& lhs, const Rhs& rhs):
+        _lhs(lhs), _rhs(rhs)
+    {
+        assert(_lhs.getWidth() == _rhs.getWidth());
+        assert(_lhs.getHeight() == _rhs.getHeight());
+        assert(_lhs.getChannels() == _rhs.getChannels());
+        assert(_lhs.getPixelLayout() == _rhs.getPixelLayout());
+    }
+
+    int getWidth() const { return _lhs.getWidth(); }
+    int getHeight() const { return _lhs.getHeight(); }
+    int getChannels() const { return _lhs.getChannels(); }
+    PixelLayout getPixelLayout() const { return _lhs.getPixelLayout(); }
+    const typename ImageExpressionTraits<Lhs>::OperandType& getLhs() const { return _lhs; }
+    const typename ImageExpressionTraits<Rhs>::OperandType& getRhs() const { return _rhs; }
+    float operator()(int y, size_t i) const { return Operation::apply(_lhs(y, i), _rhs(y, i)); }
+
+private:
+    typename ImageExpressionTraits<Lhs>::OperandType _lhs;
+    typename ImageExpressionTraits<Rhs>::OperandType _rhs;
+};
+
+/*! \brief Multiplies every element of an expression by a constant. Negation is a scale by -1.
+ */
+template<typename Operand>
+class ScaledImageExpression: public ImageExpression<ScaledImageExpression<Operand>>
+{
+public:
+    ScaledImageExpression(float scale, const Operand& operand):
+        _scale(scale), _operand(operand)
+    {}
+
+    int getWidth() const { return _operand.getWidth(); }
+    int getHeight() const { return _operand.getHeight(); }
+    int getChannels() const { return _operand.getChannels(); }
+    PixelLayout getPixelLayout() const { return _operand.getPixelLayout(); }
+    float getScale() const { return _scale; }
+    const typename ImageExpressionTraits<Operand>::OperandType& getOperand() const { return _operand; }
+    float operator()(int y, size_t i) const { return _scale * _operand(y, i); }
+
+private:
+    float _scale;
+    typename ImageExpressionTraits<Operand>::OperandType _operand;
+};
+
+namespace detail
+{
+
+/*! The planes of a planar image follow each other so its memory is treated as channels * height
+ *  rows of width elements. Interleaved images have height rows of width * channels elements.
+ *  @return The number of rows an expression is evaluated in.
+ */
+template<typename Expression>
+int getExpressionRows(const Expression& expression)
+{
+    const bool planar = expression.getPixelLayout() == PixelLayout::Planar;
+    return planar ? expression.getHeight() * expression.getChannels() : expression.getHeight();
+}
+
+/*! @return The number of elements in each row returned by getExpressionRows.
+ */
+template<typename Expression>
+size_t getExpressionRowSize(const Expression& expression)
+{
+    const bool planar = expression.getPixelLayout() == PixelLayout::Planar;
+    const size_t width = static_cast<size_t>(expression.getWidth());
+    return planar ? width : width * expression.getChannels();
+}
+
+/*! Writes the elements of an expression to 'dst' row by row. 'dst' may be one of the operands.
+ *  @param[in] dst The pixels of an image with the size and pixel layout of the expression.
+ */
+template<typename Expression>
+void evaluateImageExpression(const Expression& expression, const ImageView& dst)
+{
+    const size_t rowSize = getExpressionRowSize(expression);
+    const int rows = getExpressionRows(expression);
+    for (int y = 0; y < rows; ++y) {
+        float* dstRow = getExpressionRowPointer(dst, expression.getPixelLayout(), y);
+        for (size_t i = 0; i < rowSize; ++i) {
+            dstRow[i] = expression(y, i);
+        }
+    }
+}
+
+// The common expressions that only involve one or two images are evaluated with the
+// explicitly vectorized routines in elementwise.h instead.
+typedef ScaledImageExpression<Image> ScaledImage;
+void evaluateImageExpression(const ImageOperand& expression, const ImageView& dst);
+void evaluateImageExpression(const ScaledImage& expression, const ImageView& dst);
+void evaluateImageExpression(const BinaryImageExpression<AddOperation, Image, Image>& expression,
+                             const ImageView& dst);
+void evaluateImageExpression(const BinaryImageExpression<SubtractOperation, Image, Image>& expression,
+                             const ImageView& dst);
+void evaluateImageExpression(const BinaryImageExpression<AddOperation, ScaledImage, Image>& expression,
+                             const ImageView& dst);
+void evaluateImageExpression(const BinaryImageExpression<AddOperation, Image, ScaledImage>& expression,
+                             const ImageView& dst);
+void evaluateImageExpression(const BinaryImageExpression<AddOperation, ScaledImage, ScaledImage>& expression,
+                             const ImageView& dst);
+void evaluateImageExpression(const BinaryImageExpression<SubtractOperation, ScaledImage, Image>& expression,
+                             const ImageView& dst);
+void evaluateImageExpression(const BinaryImageExpression<SubtractOperation, Image, ScaledImage>& expression,
+                             const ImageView& dst);
+void evaluateImageExpression(const BinaryImageExpression<SubtractOperation, ScaledImage, ScaledImage>& expression,
+                             const ImageView& dst);
+
+}
+
+/*! Add images element-wise.
+ *  @return An expression that evaluates to lhs + rhs.
+ */
+template<typename Lhs, typename Rhs>
+BinaryImageExpression<detail::AddOperation, Lhs, Rhs> operator+(const ImageExpression<Lhs>& lhs,
+                                                                 const ImageExpression<Rhs>& rhs)
+{
+    return BinaryImageExpression<detail::AddOperation, Lhs, Rhs>(lhs.derived(), rhs.derived());
+}
+
+/*! Subtract images element-wise.
+ *  @return An expression that evaluates to lhs - rhs.
+ */
+template<typename Lhs, typename Rhs>
+BinaryImageExpression<detail::SubtractOperation, Lhs, Rhs> operator-(const ImageExpression<Lhs>& lhs,
+                                                                      const ImageExpression<Rhs>& rhs)
+{
+    return BinaryImageExpression<detail::SubtractOperation, Lhs, Rhs>(lhs.derived(), rhs.derived());
+}
+
+/*! Negates every element.
+ *  @return An expression that evaluates to -operand.
+ */
+template<typename Operand>
+ScaledImageExpression<Operand> operator-(const ImageExpression<Operand>& operand)
+{
+    return ScaledImageExpression<Operand>(-1.0f, operand.derived());
+}
+
+/*! Multiplies every element by a constant.
+ *  @return An expression that evaluates to scale * operand.
+ */
+template<typename Operand>
+ScaledImageExpression<Operand> operator*(float scale, const ImageExpression<Operand>& operand)
+{
+    return ScaledImageExpression<Operand>(scale, operand.derived());
+}
+
+template<typename Operand>
+ScaledImageExpression<Operand> operator*(const ImageExpression<Operand>& operand, float scale)
+{
+    return ScaledImageExpression<Operand>(scale, operand.derived());
+}
+
+}
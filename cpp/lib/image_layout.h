@@ -0,0 +1,72 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#pragma once
+
+namespace sift
+{
+
+/*! \brief How the rows of an Image are laid out in memory.
+ */
+enum class RowPadding
+{
+    /*! Rows follow each other without any gaps.
+     */
+    None,
+
+    /*! Every row starts on a new 64 byte cache line, so rows can be loaded with aligned SIMD loads.
+     *  Strides that are a multiple of 4096 bytes get one more cache line so that vertically
+     *  adjacent pixels do not alias in the L1 cache.
+     */
+    CacheLine
+};
+
+/*! \brief How the channels of an Image are laid out in memory.
+ */
+enum class PixelLayout
+{
+    /*! The channels of a pixel are next to each other (RGBRGB...).
+     */
+    Interleaved,
+
+    /*! Every channel is stored in its own plane (RR...GG...BB...), so filters that work on one
+     *  channel at a time read contiguous memory.
+     */
+    Planar
+};
+
+/*! \brief How the halo around an Image is filled from the pixels at its edges.
+ */
+enum class BorderMode
+{
+    /*! The edge pixels are repeated (aaa|abcd), which matches clamping the coordinates.
+     */
+    Replicate,
+
+    /*! The image is reflected at its edges including the edge pixels (cba|abcd).
+     */
+    Mirror
+};
+
+/*! \brief How resampleImage computes a pixel of the resampled image.
+ */
+enum class ResampleMode
+{
+    /*! Pixel (x, y) is the pixel (x * fx, y * fy) rounded down, which aliases when shrinking.
+     */
+    Nearest,
+
+    /*! Pixel centers are mapped onto the source and interpolated between the 2 x 2 closest pixels.
+     *  Only reads two rows and columns per pixel, so it aliases when shrinking by more than 2.
+     */
+    Bilinear,
+
+    /*! Every pixel is the average of the fx x fy area of the source it covers, weighting the
+     *  pixels that are partially covered by how much of them is. Shrinks without aliasing.
+     */
+    Area
+};
+
+}
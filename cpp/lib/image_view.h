@@ -0,0 +1,196 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+
+namespace sift
+{
+
+/*! \brief A non-owning view of image data.
+ *
+ *  Element (x, y, c) is at x * getPixelStride() + y * getStride() + c * getChannelStride() elements
+ *  from getData(), which describes both pixel layouts of an Image as well as parts of them.
+ *  Views are cheap to copy and cropping or picking a channel never copies any pixels.
+ *  The view does not manage the lifetime of the data it points to. T is the pixel type of the
+ *  image (see PixelTraits) for a writable view, e.g. 'float', or the const version of it for a
+ *  read-only view, e.g. 'const uint8_t'.
+ */
+template <typename T>
+class BasicImageView
+{
+public:
+    /*! Creates an empty view.
+     */
+    BasicImageView():
+        _data(nullptr), _stride(0), _pixelStride(0), _channelStride(0), _width(0), _height(0), _channels(0)
+    {}
+
+    /*! Creates a view of packed interleaved data.
+     *  @param[in] data Pointer to the first element. Must hold width * height * channels elements.
+     *  @param[in] width Width of the image.
+     *  @param[in] height Height of the image.
+     *  @param[in] channels Number of image color channels.
+     */
+    BasicImageView(T* data, int width, int height, int channels):
+        _data(data), _stride(static_cast<size_t>(width) * channels), _pixelStride(channels), _channelStride(1),
+        _width(width), _height(height), _channels(channels)
+    {}
+
+    /*! Creates a view of strided data.
+     *  @param[in] data Pointer to element (0, 0, 0).
+     *  @param[in] width Width of the image.
+     *  @param[in] height Height of the image.
+     *  @param[in] channels Number of image color channels.
+     *  @param[in] stride Number of elements between two vertically adjacent elements.
+     *  @param[in] pixelStride Number of elements between two horizontally adjacent elements.
+     *  @param[in] channelStride Number of elements between two channels of a pixel.
+     */
+    BasicImageView(T* data, int width, int height, int channels, size_t stride, size_t pixelStride,
+                   size_t channelStride):
+        _data(data), _stride(stride), _pixelStride(pixelStride), _channelStride(channelStride),
+        _width(width), _height(height), _channels(channels)
+    {}
+
+    /*! Allows a writable view to be used where a read-only view is expected.
+     *  @param[in] other The view to convert.
+     */
+    template <typename U,
+              typename = typename std::enable_if<std::is_convertible<U*, T*>::value>::type>
+    BasicImageView(const BasicImageView<U>& other):
+        _data(other.getData()), _stride(other.getStride()), _pixelStride(other.getPixelStride()),
+        _channelStride(other.getChannelStride()), _width(other.getWidth()), _height(other.getHeight()),
+        _channels(other.getChannels())
+    {}
+
+    /*! Retrieves width of image.
+     * @return Width of the image in pixels.
+     */
+    int getWidth() const { return _width; }
+
+    /*! Retrieves height of image.
+     * @return Height of the image in pixels.
+     */
+    int getHeight() const { return _height; }
+
+    /*! Retrieves the number of channels.
+     * @return Number of color channels.
+     */
+    int getChannels() const { return _channels; }
+
+    /*! Retrieves the number of elements in the view. They are only stored contiguously if isPacked().
+     * @return width * height * channels.
+     */
+    size_t getBufferSize() const { return static_cast<size_t>(_width) * _height * _channels; }
+
+    /*! Retrieves the distance between two vertically adjacent elements.
+     * @return Row stride in elements.
+     */
+    size_t getStride() const { return _stride; }
+
+    /*! Retrieves the distance between two horizontally adjacent elements.
+     * @return Pixel stride in elements.
+     */
+    size_t getPixelStride() const { return _pixelStride; }
+
+    /*! Retrieves the distance between two channels of a pixel.
+     * @return Channel stride in elements.
+     */
+    size_t getChannelStride() const { return _channelStride; }
+
+    /*! Checks whether the channels of a pixel are next to each other, like in an interleaved Image.
+     *  Every row then holds width * channels consecutive elements.
+     * @return True if the pixel stride is the number of channels and the channel stride is 1.
+     */
+    bool isInterleaved() const { return _channelStride == 1 && _pixelStride == static_cast<size_t>(_channels); }
+
+    /*! Checks whether the view covers width * height * channels consecutive interleaved elements.
+     * @return True if the view is interleaved and there is no gap between rows.
+     */
+    bool isPacked() const { return isInterleaved() && _stride == static_cast<size_t>(_width) * _channels; }
+
+    /*! Retrieves the data the view points to.
+     * @return Pointer to element (0, 0, 0).
+     */
+    T* getData() const { return _data; }
+
+    /*! Retrieves the first element of a row of a channel. Element x of the row is
+     *  getPixelStride() * x elements further.
+     * @param[in] y The row to query.
+     * @param[in] channel The channel to query.
+     * @return Pointer to element (0, y, channel).
+     */
+    T* getRowPointer(int y, int channel = 0) const
+    {
+        return _data + static_cast<ptrdiff_t>(y) * static_cast<ptrdiff_t>(_stride) +
+               static_cast<size_t>(channel) * _channelStride;
+    }
+
+    /*! Retrieves an element of the view.
+     * @param x The column of the image to query.
+     * @param y The row of the image to query.
+     * @param channel Which color channel to query.
+     * @return The element indexed by x, y, and channel.
+     */
+    T& operator()(int x, int y, int channel) const
+    {
+        assert(x >= 0 && x < _width && y >= 0 && y < _height && channel >= 0 && channel < _channels);
+        return getRowPointer(y, channel)[static_cast<size_t>(x) * _pixelStride];
+    }
+
+    /*! Retrieves an element of the view.
+     * @param x The column of the image to query.
+     * @param y The row of the image to query.
+     * @param channel Which color channel to query.
+     * @return The element indexed by x, y, and channel.
+     */
+    typename std::remove_const<T>::type getColor(int x, int y, int channel) const { return (*this)(x, y, channel); }
+
+    /*! Creates a view of a rectangle of this view without copying.
+     * @param[in] x The first column of the rectangle.
+     * @param[in] y The first row of the rectangle.
+     * @param[in] width Width of the rectangle. x + width must not exceed the width of this view.
+     * @param[in] height Height of the rectangle. y + height must not exceed the height of this view.
+     * @return A view with the strides of this view.
+     */
+    BasicImageView crop(int x, int y, int width, int height) const
+    {
+        assert(x >= 0 && y >= 0 && width >= 0 && height >= 0 && x + width <= _width && y + height <= _height);
+        return BasicImageView(getRowPointer(y) + static_cast<size_t>(x) * _pixelStride, width, height, _channels,
+                              _stride, _pixelStride, _channelStride);
+    }
+
+    /*! Creates a single channel view of one of the channels without copying.
+     * @param[in] channel The channel to view.
+     * @return A view with one channel and the strides of this view.
+     */
+    BasicImageView getChannel(int channel) const
+    {
+        assert(channel >= 0 && channel < _channels);
+        return BasicImageView(getRowPointer(0, channel), _width, _height, 1, _stride, _pixelStride, 1);
+    }
+
+private:
+    T* _data;
+    size_t _stride;
+    size_t _pixelStride;
+    size_t _channelStride;
+    int _width;
+    int _height;
+    int _channels;
+};
+
+/*! A view that allows the image data to be modified.
+ */
+typedef BasicImageView<float> ImageView;
+
+/*! A view that only allows the image data to be read.
+ */
+typedef BasicImageView<const float> ConstImageView;
+
+}
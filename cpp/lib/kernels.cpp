@@ -0,0 +1,54 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#include "kernels.h"
+#include <cassert>
+
+namespace sift
+{
+namespace detail
+{
+
+namespace
+{
+
+const KernelTable* selectKernels()
+{
+    // Fall back to lower levels if the library was built without the kernels for the best one.
+    const KernelTable* kernels = nullptr;
+    for (int level = static_cast<int>(getActiveInstructionSet()); kernels == nullptr && level >= 0; --level) {
+        kernels = getKernels(static_cast<InstructionSet>(level));
+    }
+    assert(kernels != nullptr);
+    return kernels;
+}
+
+}
+
+const KernelTable* getKernels(InstructionSet instructionSet)
+{
+    if (static_cast<int>(instructionSet) > static_cast<int>(getSupportedInstructionSet())) {
+        return nullptr;
+    }
+
+    switch (instructionSet) {
+    case InstructionSet::Scalar:
+        return getScalarKernels();
+    case InstructionSet::SSE2:
+        return getSse2Kernels();
+    case InstructionSet::AVX2:
+        return getAvx2Kernels();
+    }
+    return nullptr;
+}
+
+const KernelTable& getKernels()
+{
+    static const KernelTable* const kernels = selectKernels();
+    return *kernels;
+}
+
+}
+}
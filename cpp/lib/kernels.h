@@ -0,0 +1,81 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#pragma once
+
+#include "cpu_features.h"
+#include <cstddef>
+
+namespace sift
+{
+namespace detail
+{
+
+/*! \brief The hot loops of the library compiled for one instruction set.
+ *
+ *  kernels_impl.h holds the only implementation. It is compiled once per instruction set
+ *  (kernels_scalar.cpp, kernels_sse2.cpp and kernels_avx2.cpp) with the matching compiler flags
+ *  and getKernels() picks the table to use at runtime. See convolution.h and elementwise.h
+ *  for what each of the functions does.
+ */
+struct KernelTable
+{
+    InstructionSet instructionSet;
+
+    void (*convolveSpan)(const float* const* inputs, float* dst, size_t count, const float* taps, int radius);
+    void (*convolveSpanAndSubtract)(const float* const* inputs, float* dst, const float* subtrahend,
+                                    float* difference, size_t count, const float* taps, int radius);
+
+    /*! dst[i] = b * src[i] + a1 * prev1[i] + a2 * prev2[i] + a3 * prev3[i] with coefficients = { b, a1, a2, a3 }.
+     *  This is one step of a recursive filter run over whole rows. 'dst' may alias 'src'.
+     */
+    void (*recursiveFilterSpan)(const float* src, const float* prev1, const float* prev2, const float* prev3,
+                                float* dst, size_t count, const float* coefficients);
+
+    /*! Copies pixel 2 * i of 'src' to pixel i of 'dst' for every i < count, where a pixel is 'channels'
+     *  consecutive floats. 'src' must hold 2 * count pixels.
+     */
+    void (*decimateSpan)(const float* src, float* dst, size_t count, int channels);
+
+    /*! dst[i] = sum of weights[k * count + i] * src[offsets[i] + k * tapStride] over k < taps. This is
+     *  the horizontal pass of a resize with a coefficient table, one entry per output element.
+     */
+    void (*resampleSpan)(const float* src, const int* offsets, const float* weights, int taps, int tapStride,
+                         float* dst, size_t count);
+
+    /*! dst[i] = sum of weights[k] * inputs[k][i] over k < inputCount. This is the vertical pass of a
+     *  resize with a coefficient table.
+     */
+    void (*weightedSumSpan)(const float* const* inputs, const float* weights, int inputCount, float* dst,
+                            size_t count);
+
+    void (*add)(const float* lhs, const float* rhs, float* dst, size_t count);
+    void (*subtract)(const float* lhs, const float* rhs, float* dst, size_t count);
+    void (*negate)(const float* src, float* dst, size_t count);
+    void (*scale)(float scale, const float* src, float* dst, size_t count);
+    void (*axpby)(float alpha, const float* x, float beta, const float* y, float* dst, size_t count);
+    bool (*equal)(const float* lhs, const float* rhs, size_t count);
+};
+
+/*! Retrieves the kernels for the instruction set returned by getActiveInstructionSet.
+ *  @return The kernels that the library uses.
+ */
+const KernelTable& getKernels();
+
+/*! Retrieves the kernels for a specific instruction set. Useful to compare the implementations.
+ *  @param[in] instructionSet The instruction set.
+ *  @return The kernels or nullptr if they were not compiled for this platform or the CPU does
+ *          not support the instruction set.
+ */
+const KernelTable* getKernels(InstructionSet instructionSet);
+
+// Defined by the per instruction set translation units. Return nullptr if the instruction set
+// is not available on the target architecture.
+const KernelTable* getScalarKernels();
+const KernelTable* getSse2Kernels();
+const KernelTable* getAvx2Kernels();
+
+}
+}
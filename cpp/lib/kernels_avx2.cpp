@@ -0,0 +1,28 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+
+// Compiled with AVX2 and FMA enabled. Nothing in here may run before getKernels() has checked
+// that the CPU supports them.
+#define SIFT_KERNELS_INSTRUCTION_SET 2
+#include "kernels_impl.h"
+
+namespace sift
+{
+namespace detail
+{
+
+const KernelTable* getAvx2Kernels()
+{
+#if defined(SIFT_KERNELS_AVAILABLE)
+    static const KernelTable kernels = makeKernelTable();
+    return &kernels;
+#else
+    return nullptr;
+#endif
+}
+
+}
+}
@@ -0,0 +1,400 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+
+// Implementation of the KernelTable functions. Only included by the kernels_*.cpp files, each of
+// which defines SIFT_KERNELS_INSTRUCTION_SET to the InstructionSet value it is compiled for and
+// gets the matching compiler flags from lib/CMakeLists.txt. Everything is in an anonymous
+// namespace so that every translation unit gets its own copy.
+#pragma once
+
+#include "kernels.h"
+
+#if !defined(SIFT_KERNELS_INSTRUCTION_SET)
+#error "SIFT_KERNELS_INSTRUCTION_SET must be defined before including kernels_impl.h"
+#endif
+
+#if SIFT_KERNELS_INSTRUCTION_SET >= 2 && defined(__AVX2__)
+#define SIFT_KERNELS_AVX2 1
+#endif
+
+#if SIFT_KERNELS_INSTRUCTION_SET >= 1 && \
+    (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SIFT_KERNELS_SSE2 1
+#endif
+
+// Set if the compiler targets the requested instruction set. Otherwise nothing is defined and the
+// translation unit reports that it has no kernels.
+#if SIFT_KERNELS_INSTRUCTION_SET == 0 || (SIFT_KERNELS_INSTRUCTION_SET == 1 && defined(SIFT_KERNELS_SSE2)) || \
+    (SIFT_KERNELS_INSTRUCTION_SET == 2 && defined(SIFT_KERNELS_AVX2))
+#define SIFT_KERNELS_AVAILABLE 1
+#endif
+
+#if defined(SIFT_KERNELS_AVX2) || defined(SIFT_KERNELS_SSE2)
+#include <immintrin.h>
+#endif
+
+#if defined(SIFT_KERNELS_AVAILABLE)
+
+namespace sift
+{
+namespace detail
+{
+namespace
+{
+
+// The vectorized loops handle as many elements as they can and leave the rest to the scalar
+// loops, which is why every scalar loop takes the index to start from.
+
+/*! Convolves floats [begin, end) and, if 'WithDifference' is set, also stores the result minus
+ *  'subtrahend' in 'difference' while the result is still in a register.
+ */
+template<bool WithDifference>
+void convolveSpanRange(const float* const* inputs, float* dst, const float* subtrahend, float* difference,
+                       size_t begin, size_t end, const float* taps, int radius)
+{
+    const float* center = inputs[radius];
+    for (size_t i = begin; i < end; ++i) {
+        float sum = taps[0] * center[i];
+        for (int k = 1; k <= radius; ++k) {
+            sum += taps[k] * (inputs[radius - k][i] + inputs[radius + k][i]);
+        }
+        dst[i] = sum;
+        if (WithDifference) {
+            difference[i] = sum - subtrahend[i];
+        }
+    }
+}
+
+template<bool WithDifference>
+void convolveSpanImpl(const float* const* inputs, float* dst, const float* subtrahend, float* difference,
+                      size_t count, const float* taps, int radius)
+{
+    size_t i = 0;
+
+    // The kernel is symmetric so the two inputs that share a tap are summed before
+    // the multiply which halves the number of multiplies per output.
+#if defined(SIFT_KERNELS_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_mul_ps(_mm256_set1_ps(taps[0]), _mm256_loadu_ps(inputs[radius] + i));
+        for (int k = 1; k <= radius; ++k) {
+            const __m256 pair = _mm256_add_ps(_mm256_loadu_ps(inputs[radius - k] + i),
+                                              _mm256_loadu_ps(inputs[radius + k] + i));
+            sum = _mm256_fmadd_ps(_mm256_set1_ps(taps[k]), pair, sum);
+        }
+        _mm256_storeu_ps(dst + i, sum);
+        if (WithDifference) {
+            _mm256_storeu_ps(difference + i, _mm256_sub_ps(sum, _mm256_loadu_ps(subtrahend + i)));
+        }
+    }
+#endif
+
+#if defined(SIFT_KERNELS_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(taps[0]), _mm_loadu_ps(inputs[radius] + i));
+        for (int k = 1; k <= radius; ++k) {
+            const __m128 pair = _mm_add_ps(_mm_loadu_ps(inputs[radius - k] + i),
+                                           _mm_loadu_ps(inputs[radius + k] + i));
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(taps[k]), pair));
+        }
+        _mm_storeu_ps(dst + i, sum);
+        if (WithDifference) {
+            _mm_storeu_ps(difference + i, _mm_sub_ps(sum, _mm_loadu_ps(subtrahend + i)));
+        }
+    }
+#endif
+
+    convolveSpanRange<WithDifference>(inputs, dst, subtrahend, difference, i, count, taps, radius);
+}
+
+void convolveSpanKernel(const float* const* inputs, float* dst, size_t count, const float* taps, int radius)
+{
+    convolveSpanImpl<false>(inputs, dst, nullptr, nullptr, count, taps, radius);
+}
+
+void convolveSpanAndSubtractKernel(const float* const* inputs, float* dst, const float* subtrahend,
+                                   float* difference, size_t count, const float* taps, int radius)
+{
+    convolveSpanImpl<true>(inputs, dst, subtrahend, difference, count, taps, radius);
+}
+
+void recursiveFilterSpanKernel(const float* src, const float* prev1, const float* prev2, const float* prev3,
+                               float* dst, size_t count, const float* coefficients)
+{
+    // Simple enough for the compiler to vectorize with whatever instruction set it targets.
+    const float b = coefficients[0];
+    const float a1 = coefficients[1];
+    const float a2 = coefficients[2];
+    const float a3 = coefficients[3];
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = b * src[i] + a1 * prev1[i] + a2 * prev2[i] + a3 * prev3[i];
+    }
+}
+
+void decimateSpanKernel(const float* src, float* dst, size_t count, int channels)
+{
+    // The even pixels of two loaded vectors are picked with one shuffle. AVX2 shuffles within
+    // 128-bit lanes so the 64-bit halves are put back in order with a permute. Pixels of 3 floats
+    // do not line up with the vectors and are copied by the scalar loop.
+    size_t i = 0;
+#if defined(SIFT_KERNELS_AVX2)
+    if (channels == 1) {
+        for (; i + 8 <= count; i += 8) {
+            const __m256 even = _mm256_shuffle_ps(_mm256_loadu_ps(src + 2 * i), _mm256_loadu_ps(src + 2 * i + 8),
+                                                  _MM_SHUFFLE(2, 0, 2, 0));
+            _mm256_storeu_ps(dst + i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even),
+                                                                             _MM_SHUFFLE(3, 1, 2, 0))));
+        }
+    } else if (channels == 2) {
+        for (; i + 4 <= count; i += 4) {
+            const __m256 even = _mm256_shuffle_ps(_mm256_loadu_ps(src + 4 * i), _mm256_loadu_ps(src + 4 * i + 8),
+                                                  _MM_SHUFFLE(1, 0, 1, 0));
+            _mm256_storeu_ps(dst + 2 * i, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(even),
+                                                                                 _MM_SHUFFLE(3, 1, 2, 0))));
+        }
+    } else if (channels == 4) {
+        for (; i + 2 <= count; i += 2) {
+            _mm256_storeu_ps(dst + 4 * i, _mm256_permute2f128_ps(_mm256_loadu_ps(src + 8 * i),
+                                                                 _mm256_loadu_ps(src + 8 * i + 8), 0x20));
+        }
+    }
+#endif
+#if defined(SIFT_KERNELS_SSE2)
+    if (channels == 1) {
+        for (; i + 4 <= count; i += 4) {
+            _mm_storeu_ps(dst + i, _mm_shuffle_ps(_mm_loadu_ps(src + 2 * i), _mm_loadu_ps(src + 2 * i + 4),
+                                                  _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+    } else if (channels == 2) {
+        for (; i + 2 <= count; i += 2) {
+            _mm_storeu_ps(dst + 2 * i, _mm_movelh_ps(_mm_loadu_ps(src + 4 * i), _mm_loadu_ps(src + 4 * i + 4)));
+        }
+    } else if (channels == 4) {
+        for (; i < count; ++i) {
+            _mm_storeu_ps(dst + 4 * i, _mm_loadu_ps(src + 8 * i));
+        }
+    }
+#endif
+    const size_t pixelSize = static_cast<size_t>(channels);
+    for (; i < count; ++i) {
+        for (size_t c = 0; c < pixelSize; ++c) {
+            dst[i * pixelSize + c] = src[2 * i * pixelSize + c];
+        }
+    }
+}
+
+void resampleSpanKernel(const float* src, const int* offsets, const float* weights, int taps, int tapStride,
+                        float* dst, size_t count)
+{
+    // The weights are stored tap by tap so that they can be loaded for consecutive outputs. The
+    // inputs of consecutive outputs are not consecutive so AVX2 gathers them. SSE2 has no gather
+    // and leaves everything to the scalar loop.
+    size_t i = 0;
+#if defined(SIFT_KERNELS_AVX2)
+    const __m256i tapSteps = _mm256_set1_epi32(tapStride);
+    for (; i + 8 <= count; i += 8) {
+        __m256i indices = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(offsets + i));
+        __m256 sum = _mm256_mul_ps(_mm256_loadu_ps(weights + i), _mm256_i32gather_ps(src, indices, 4));
+        for (int k = 1; k < taps; ++k) {
+            indices = _mm256_add_epi32(indices, tapSteps);
+            sum = _mm256_fmadd_ps(_mm256_loadu_ps(weights + k * count + i), _mm256_i32gather_ps(src, indices, 4),
+                                  sum);
+        }
+        _mm256_storeu_ps(dst + i, sum);
+    }
+#endif
+    for (; i < count; ++i) {
+        const float* input = src + offsets[i];
+        float sum = weights[i] * input[0];
+        for (int k = 1; k < taps; ++k) {
+            sum += weights[k * count + i] * input[k * tapStride];
+        }
+        dst[i] = sum;
+    }
+}
+
+void weightedSumSpanKernel(const float* const* inputs, const float* weights, int inputCount, float* dst,
+                           size_t count)
+{
+    size_t i = 0;
+#if defined(SIFT_KERNELS_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        __m256 sum = _mm256_mul_ps(_mm256_set1_ps(weights[0]), _mm256_loadu_ps(inputs[0] + i));
+        for (int k = 1; k < inputCount; ++k) {
+            sum = _mm256_fmadd_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(inputs[k] + i), sum);
+        }
+        _mm256_storeu_ps(dst + i, sum);
+    }
+#endif
+#if defined(SIFT_KERNELS_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        __m128 sum = _mm_mul_ps(_mm_set1_ps(weights[0]), _mm_loadu_ps(inputs[0] + i));
+        for (int k = 1; k < inputCount; ++k) {
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(inputs[k] + i)));
+        }
+        _mm_storeu_ps(dst + i, sum);
+    }
+#endif
+    for (; i < count; ++i) {
+        float sum = weights[0] * inputs[0][i];
+        for (int k = 1; k < inputCount; ++k) {
+            sum += weights[k] * inputs[k][i];
+        }
+        dst[i] = sum;
+    }
+}
+
+void addKernel(const float* lhs, const float* rhs, float* dst, size_t count)
+{
+    size_t i = 0;
+#if defined(SIFT_KERNELS_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(lhs + i), _mm256_loadu_ps(rhs + i)));
+    }
+#endif
+#if defined(SIFT_KERNELS_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(lhs + i), _mm_loadu_ps(rhs + i)));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = lhs[i] + rhs[i];
+    }
+}
+
+void subtractKernel(const float* lhs, const float* rhs, float* dst, size_t count)
+{
+    size_t i = 0;
+#if defined(SIFT_KERNELS_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_sub_ps(_mm256_loadu_ps(lhs + i), _mm256_loadu_ps(rhs + i)));
+    }
+#endif
+#if defined(SIFT_KERNELS_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_sub_ps(_mm_loadu_ps(lhs + i), _mm_loadu_ps(rhs + i)));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = lhs[i] - rhs[i];
+    }
+}
+
+void negateKernel(const float* src, float* dst, size_t count)
+{
+    // Flipping the sign bit is exactly what unary minus does, including for zeros and NaNs.
+    size_t i = 0;
+#if defined(SIFT_KERNELS_AVX2)
+    const __m256 signMask8 = _mm256_set1_ps(-0.0f);
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_xor_ps(_mm256_loadu_ps(src + i), signMask8));
+    }
+#endif
+#if defined(SIFT_KERNELS_SSE2)
+    const __m128 signMask4 = _mm_set1_ps(-0.0f);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_xor_ps(_mm_loadu_ps(src + i), signMask4));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = -src[i];
+    }
+}
+
+void scaleKernel(float scale, const float* src, float* dst, size_t count)
+{
+    size_t i = 0;
+#if defined(SIFT_KERNELS_AVX2)
+    const __m256 scales8 = _mm256_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(scales8, _mm256_loadu_ps(src + i)));
+    }
+#endif
+#if defined(SIFT_KERNELS_SSE2)
+    const __m128 scales4 = _mm_set1_ps(scale);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_mul_ps(scales4, _mm_loadu_ps(src + i)));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = scale * src[i];
+    }
+}
+
+void axpbyKernel(float alpha, const float* x, float beta, const float* y, float* dst, size_t count)
+{
+    size_t i = 0;
+#if defined(SIFT_KERNELS_AVX2)
+    const __m256 alphas8 = _mm256_set1_ps(alpha);
+    const __m256 betas8 = _mm256_set1_ps(beta);
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_fmadd_ps(alphas8, _mm256_loadu_ps(x + i),
+                                                  _mm256_mul_ps(betas8, _mm256_loadu_ps(y + i))));
+    }
+#endif
+#if defined(SIFT_KERNELS_SSE2)
+    const __m128 alphas4 = _mm_set1_ps(alpha);
+    const __m128 betas4 = _mm_set1_ps(beta);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(alphas4, _mm_loadu_ps(x + i)),
+                                          _mm_mul_ps(betas4, _mm_loadu_ps(y + i))));
+    }
+#endif
+    for (; i < count; ++i) {
+        dst[i] = alpha * x[i] + beta * y[i];
+    }
+}
+
+bool equalKernel(const float* lhs, const float* rhs, size_t count)
+{
+    // Ordered compares so that NaNs are never equal, like operator== on floats.
+    size_t i = 0;
+#if defined(SIFT_KERNELS_AVX2)
+    for (; i + 8 <= count; i += 8) {
+        const __m256 equal = _mm256_cmp_ps(_mm256_loadu_ps(lhs + i), _mm256_loadu_ps(rhs + i), _CMP_EQ_OQ);
+        if (_mm256_movemask_ps(equal) != 0xFF) {
+            return false;
+        }
+    }
+#endif
+#if defined(SIFT_KERNELS_SSE2)
+    for (; i + 4 <= count; i += 4) {
+        if (_mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(lhs + i), _mm_loadu_ps(rhs + i))) != 0xF) {
+            return false;
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        if (lhs[i] != rhs[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+KernelTable makeKernelTable()
+{
+    KernelTable kernels;
+    kernels.instructionSet = static_cast<InstructionSet>(SIFT_KERNELS_INSTRUCTION_SET);
+    kernels.convolveSpan = convolveSpanKernel;
+    kernels.convolveSpanAndSubtract = convolveSpanAndSubtractKernel;
+    kernels.recursiveFilterSpan = recursiveFilterSpanKernel;
+    kernels.decimateSpan = decimateSpanKernel;
+    kernels.resampleSpan = resampleSpanKernel;
+    kernels.weightedSumSpan = weightedSumSpanKernel;
+    kernels.add = addKernel;
+    kernels.subtract = subtractKernel;
+    kernels.negate = negateKernel;
+    kernels.scale = scaleKernel;
+    kernels.axpby = axpbyKernel;
+    kernels.equal = equalKernel;
+    return kernels;
+}
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,23 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+
+// Compiled without vectorization so that SIFT_ISA=scalar gives a true scalar baseline.
+#define SIFT_KERNELS_INSTRUCTION_SET 0
+#include "kernels_impl.h"
+
+namespace sift
+{
+namespace detail
+{
+
+const KernelTable* getScalarKernels()
+{
+    static const KernelTable kernels = makeKernelTable();
+    return &kernels;
+}
+
+}
+}
@@ -0,0 +1,26 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+
+#define SIFT_KERNELS_INSTRUCTION_SET 1
+#include "kernels_impl.h"
+
+namespace sift
+{
+namespace detail
+{
+
+const KernelTable* getSse2Kernels()
+{
+#if defined(SIFT_KERNELS_AVAILABLE)
+    static const KernelTable kernels = makeKernelTable();
+    return &kernels;
+#else
+    return nullptr;
+#endif
+}
+
+}
+}
@@ -0,0 +1,96 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <exception>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace sift
+{
+
+namespace
+{
+
+std::atomic<int> threadCount(0);
+
+}
+
+void setThreadCount(int count)
+{
+    assert(count >= 0);
+    threadCount = count;
+}
+
+int getThreadCount()
+{
+    const int count = threadCount;
+    if (count > 0) {
+        return count;
+    }
+    const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    return (hardwareThreads > 0) ? static_cast<int>(hardwareThreads) : 1;
+}
+
+namespace detail
+{
+
+void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body)
+{
+    assert(grain > 0);
+    if (begin >= end) {
+        return;
+    }
+
+    const int64_t count = static_cast<int64_t>(end) - begin;
+    const int chunks = static_cast<int>(std::min<int64_t>(getThreadCount(), (count + grain - 1) / grain));
+    if (chunks <= 1) {
+        body(begin, end);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(chunks);
+    const auto runChunk = [&](int chunk) {
+        const int chunkBegin = static_cast<int>(begin + count * chunk / chunks);
+        const int chunkEnd = static_cast<int>(begin + count * (chunk + 1) / chunks);
+        try {
+            body(chunkBegin, chunkEnd);
+        } catch (...) {
+            errors[chunk] = std::current_exception();
+        }
+    };
+
+    // Chunks that do not get a thread because the system is out of them run on this thread.
+    std::vector<std::thread> threads;
+    threads.reserve(chunks - 1);
+    int chunk = 1;
+    try {
+        for (; chunk < chunks; ++chunk) {
+            threads.emplace_back(runChunk, chunk);
+        }
+    } catch (const std::system_error&) {
+    }
+    for (int remaining = chunk; remaining < chunks; ++remaining) {
+        runChunk(remaining);
+    }
+    runChunk(0);
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (const std::exception_ptr& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+}
+}
@@ -0,0 +1,38 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#pragma once
+
+#include <functional>
+
+namespace sift
+{
+
+/*! Sets how many threads the library may use for one operation, the calling thread included.
+ *  @param[in] count Number of threads. 0 uses one thread per hardware thread, which is the default.
+ */
+void setThreadCount(int count);
+
+/*! Retrieves how many threads the library may use for one operation.
+ *  @return The count given to setThreadCount or the number of hardware threads if it is 0.
+ */
+int getThreadCount();
+
+namespace detail
+{
+
+/*! Splits [begin, end) into at most getThreadCount() contiguous chunks of at least 'grain'
+ *  indices and calls 'body' once per chunk. One chunk runs on the calling thread and the others
+ *  on new threads, so 'body' must be safe to call concurrently for different chunks. Returns once
+ *  every chunk is done and rethrows the first exception 'body' threw, if any.
+ *  @param[in] begin First index.
+ *  @param[in] end One past the last index.
+ *  @param[in] grain Smallest number of indices worth a thread of its own.
+ *  @param[in] body Called with the first and one past the last index of a chunk.
+ */
+void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body);
+
+}
+}
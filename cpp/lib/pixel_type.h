@@ -0,0 +1,195 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+namespace sift
+{
+
+/*! \brief A 16-bit IEEE 754 floating point number.
+ *
+ *  Only meant for storing pixels, all arithmetic happens after converting to float.
+ *  Converting from float rounds to the nearest half, ties to even, and keeps infinities and NaNs.
+ */
+class half
+{
+public:
+    /*! Creates a positive zero.
+     */
+    half():
+        _bits(0)
+    {}
+
+    /*! Rounds a float to the nearest half.
+     *  @param[in] value The value to convert. Values too large for a half become infinity.
+     */
+    half(float value):
+        _bits(fromFloat(value))
+    {}
+
+    /*! Converts to float, which is exact.
+     */
+    operator float() const { return toFloat(_bits); }
+
+    /*! Creates a half from its binary representation.
+     *  @param[in] bits Sign bit, 5 exponent bits and 10 mantissa bits.
+     *  @return The half with these bits.
+     */
+    static half fromBits(uint16_t bits)
+    {
+        half value;
+        value._bits = bits;
+        return value;
+    }
+
+    /*! Retrieves the binary representation.
+     *  @return Sign bit, 5 exponent bits and 10 mantissa bits.
+     */
+    uint16_t getBits() const { return _bits; }
+
+private:
+    static uint16_t fromFloat(float value);
+    static float toFloat(uint16_t bits);
+
+    uint16_t _bits;
+};
+
+static_assert(sizeof(half) == 2, "half must have the size of the 16-bit float it stores.");
+
+inline uint16_t half::fromFloat(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    const uint32_t magnitude = bits & 0x7FFFFFFF;
+
+    if (magnitude >= 0x7F800000) {
+        // Infinity stays infinity and NaNs stay quiet NaNs.
+        return sign | 0x7C00 | ((magnitude > 0x7F800000) ? 0x0200 : 0);
+    }
+
+    if (magnitude >= 0x477FF000) {
+        // 65520 is halfway between the largest half, 65504, and 65536, which rounds to infinity.
+        return sign | 0x7C00;
+    }
+
+    if (magnitude < 0x38800000) {
+        // Below the smallest normal half the result is a multiple of 2^-24. Rounding with the
+        // default rounding mode ties to even and gives the smallest normal half if it rounds up to it.
+        float absValue;
+        std::memcpy(&absValue, &magnitude, sizeof(absValue));
+        return sign | static_cast<uint16_t>(std::nearbyint(std::ldexp(absValue, 24)));
+    }
+
+    // Rebias the exponent from 127 to 15 and round away the 13 lowest mantissa bits to even.
+    // A carry out of the mantissa correctly increments the exponent.
+    uint32_t rebiased = magnitude - 0x38000000;
+    rebiased += 0x0FFF + ((rebiased >> 13) & 1);
+    return sign | static_cast<uint16_t>(rebiased >> 13);
+}
+
+inline float half::toFloat(uint16_t bits)
+{
+    const uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+    const uint32_t exponent = (bits >> 10) & 0x1F;
+    const uint32_t mantissa = bits & 0x3FF;
+
+    uint32_t result;
+    if (exponent == 0) {
+        const float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -magnitude : magnitude;
+    } else if (exponent == 0x1F) {
+        result = sign | 0x7F800000 | (mantissa << 13);
+    } else {
+        result = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &result, sizeof(value));
+    return value;
+}
+
+/*! \brief Maps the pixel types an image can be stored in to the floats the filters work with.
+ *
+ *  Integer pixels are normalized so that the largest value of the type is 1, which is what
+ *  OpenImageIO does when it converts them to float. Floating point pixels are not scaled.
+ */
+template<typename T>
+struct PixelTraits;
+
+template<>
+struct PixelTraits<float>
+{
+    static float toFloat(float value) { return value; }
+    static float fromFloat(float value) { return value; }
+};
+
+template<>
+struct PixelTraits<half>
+{
+    static float toFloat(half value) { return value; }
+    static half fromFloat(float value) { return half(value); }
+};
+
+template<>
+struct PixelTraits<uint8_t>
+{
+    static float toFloat(uint8_t value) { return value / 255.0f; }
+    static uint8_t fromFloat(float value)
+    {
+        return static_cast<uint8_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+};
+
+template<>
+struct PixelTraits<uint16_t>
+{
+    static float toFloat(uint16_t value) { return value / 65535.0f; }
+    static uint16_t fromFloat(float value)
+    {
+        return static_cast<uint16_t>(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f + 0.5f);
+    }
+};
+
+/*! Converts a pixel from one type to another through float.
+ *  @param[in] value The pixel to convert.
+ *  @return The closest value of type Dst.
+ */
+template<typename Dst, typename Src>
+Dst convertPixel(Src value)
+{
+    return PixelTraits<Dst>::fromFloat(PixelTraits<Src>::toFloat(value));
+}
+
+template<>
+inline float convertPixel<float, float>(float value)
+{
+    return value;
+}
+
+template<>
+inline uint8_t convertPixel<uint8_t, uint8_t>(uint8_t value)
+{
+    return value;
+}
+
+template<>
+inline uint16_t convertPixel<uint16_t, uint16_t>(uint16_t value)
+{
+    return value;
+}
+
+template<>
+inline half convertPixel<half, half>(half value)
+{
+    return value;
+}
+
+}
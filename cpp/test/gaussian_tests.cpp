@@ -0,0 +1,543 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+
+#define CATCH_CONFIG_MAIN 
+#include "catch.hpp"
+#include <algorithm>
+#include <cmath>
+#include "gaussian.h"
+#include <random>
+#include <vector>
+
+namespace
+{
+
+sift::Image createRandomImage(int width, int height, int channels,
+                              sift::RowPadding padding = sift::RowPadding::None)
+{
+    std::mt19937 gen(1234);
+    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+
+    sift::Image image(width, height, channels, padding);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                image.setColor(dist(gen), x, y, c);
+            }
+        }
+    }
+    return image;
+}
+
+void checkImagesClose(const sift::Image& a, const sift::Image& b)
+{
+    REQUIRE(a.getWidth() == b.getWidth());
+    REQUIRE(a.getHeight() == b.getHeight());
+    REQUIRE(a.getChannels() == b.getChannels());
+    for (int y = 0; y < a.getHeight(); ++y) {
+        for (int x = 0; x < a.getWidth(); ++x) {
+            for (int c = 0; c < a.getChannels(); ++c) {
+                REQUIRE(a.getColor(x, y, c) == Approx(b.getColor(x, y, c)).epsilon(1e-4));
+            }
+        }
+    }
+}
+
+}
+
+TEST_CASE("Gaussian kernel taps", "[gaussian]") {
+    const sift::Gaussian2D gaussian = sift::create2DGaussian(1.6f);
+    CHECK(gaussian.getStddev() == Approx(1.6f));
+    CHECK(gaussian.getRadius() == 7);
+
+    const float* taps = gaussian.getTaps();
+    double sum = taps[0];
+    for (int k = 1; k <= gaussian.getRadius(); ++k) {
+        CHECK(taps[k] < taps[k - 1]);
+        sum += 2.0 * taps[k];
+    }
+    CHECK(sum == Approx(1.0));
+    CHECK(taps[1] / taps[0] == Approx(std::exp(-1.0 / (2.0 * 1.6 * 1.6))));
+
+    const sift::Gaussian2D identity = sift::create2DGaussian(0.0f);
+    CHECK(identity.getRadius() == 0);
+    CHECK(identity.getTaps()[0] == 1.0f);
+
+    REQUIRE_THROWS_AS(sift::create2DGaussian(-1.0f), std::invalid_argument);
+}
+
+TEST_CASE("Gaussian convolution matches reference", "[gaussian]") {
+    const sift::Gaussian2D gaussian = sift::create2DGaussian(2.0f);
+    sift::Image image;
+
+    SECTION("single channel") {
+        image = createRandomImage(67, 41, 1);
+    }
+
+    SECTION("three channels") {
+        image = createRandomImage(37, 29, 3);
+    }
+
+    SECTION("smaller than the kernel") {
+        image = createRandomImage(3, 5, 2);
+    }
+
+    SECTION("padded rows") {
+        image = createRandomImage(37, 29, 3, sift::RowPadding::CacheLine);
+    }
+
+    SECTION("planar channels") {
+        image = sift::convertPixelLayout(createRandomImage(37, 29, 3), sift::PixelLayout::Planar);
+    }
+
+    SECTION("halo") {
+        image = createRandomImage(37, 29, 3);
+        image.setHalo(gaussian.getRadius());
+    }
+
+    SECTION("planar halo") {
+        image = sift::convertPixelLayout(createRandomImage(37, 29, 3), sift::PixelLayout::Planar);
+        image.setHalo(gaussian.getRadius() + 2);
+    }
+
+    const sift::Image expected = sift::convolveGaussian2DReference(gaussian, image);
+    const sift::Image actual = sift::convolveGaussian2D(gaussian, image);
+    CHECK(actual.getRowPadding() == image.getRowPadding());
+    CHECK(actual.getPixelLayout() == image.getPixelLayout());
+    checkImagesClose(actual, expected);
+
+    sift::convolveGaussian2DInPlace(gaussian, &image);
+    checkImagesClose(image, expected);
+}
+
+TEST_CASE("Gaussian convolution of views", "[gaussian]") {
+    const sift::Gaussian2D gaussian = sift::create2DGaussian(1.5f);
+    sift::Image image = createRandomImage(40, 30, 3);
+    const sift::Image original = image;
+
+    // Crops are clamped at their own border, exactly like a copy of them.
+    const sift::ConstImageView crop = original.getView().crop(5, 7, 21, 13);
+    const sift::Image expected = sift::convolveGaussian2D(gaussian, sift::Image(crop));
+    sift::Image actual(21, 13, 3);
+    sift::convolveGaussian2D(gaussian, crop, actual);
+    CHECK(actual == expected);
+
+    // Filtering a crop in place leaves the rest of the image alone.
+    const sift::ImageView inPlace = image.getView().crop(5, 7, 21, 13);
+    sift::convolveGaussian2D(gaussian, inPlace, inPlace);
+    CHECK(sift::Image(inPlace) == expected);
+    CHECK(image.getColor(4, 7, 0) == original.getColor(4, 7, 0));
+    CHECK(image.getColor(26, 19, 2) == original.getColor(26, 19, 2));
+
+    // A single channel of an interleaved image is strided.
+    const sift::ConstImageView green = original.getView().getChannel(1);
+    sift::Image greenResult(40, 30, 1);
+    sift::convolveGaussian2D(gaussian, green, greenResult);
+    checkImagesClose(greenResult, sift::convolveGaussian2DReference(gaussian, sift::Image(green)));
+
+    // Pyramids read views without copying them first.
+    const sift::DoGScaleSpacePyramid fromView(crop, 2);
+    const sift::DoGScaleSpacePyramid fromCopy(sift::Image(crop), 2);
+    for (int o = 0; o < fromView.getOctaves(); ++o) {
+        for (int s = 0; s < fromView.getDoGsPerOctave(); ++s) {
+            const sift::ConstImageView a = fromView.getDoG(o, s);
+            const sift::ConstImageView b = fromCopy.getDoG(o, s);
+            REQUIRE(std::equal(a.getData(), a.getData() + a.getBufferSize(), b.getData()));
+        }
+    }
+}
+
+TEST_CASE("Gaussian convolution reads the halo", "[gaussian]") {
+    const sift::Gaussian2D gaussian = sift::create2DGaussian(1.5f);
+    const int radius = gaussian.getRadius();
+    sift::Image image = createRandomImage(31, 23, 2);
+    image.setHalo(radius, sift::BorderMode::Mirror);
+
+    // Convolving the image together with its halo and cropping gives the mirrored result.
+    sift::Image extended(31 + 2 * radius, 23 + 2 * radius, 2);
+    for (int y = 0; y < extended.getHeight(); ++y) {
+        for (int x = 0; x < extended.getWidth(); ++x) {
+            for (int c = 0; c < 2; ++c) {
+                extended.setColor(image.getColorUnclamped(x - radius, y - radius, c), x, y, c);
+            }
+        }
+    }
+    const sift::Image expected = sift::convolveGaussian2DReference(gaussian, extended);
+
+    const sift::Image actual = sift::convolveGaussian2D(gaussian, image);
+    CHECK(actual.getHalo() == radius);
+    CHECK(actual.getBorderMode() == sift::BorderMode::Mirror);
+    for (int y = 0; y < 23; ++y) {
+        for (int x = 0; x < 31; ++x) {
+            for (int c = 0; c < 2; ++c) {
+                REQUIRE(actual.getColor(x, y, c) ==
+                        Approx(expected.getColor(x + radius, y + radius, c)).epsilon(1e-4));
+            }
+        }
+    }
+
+    // The halo of the result is filled as well.
+    CHECK(actual.getColorUnclamped(-1, 3, 1) == actual.getColor(0, 3, 1));
+    CHECK(actual.getColorUnclamped(31, 22 + radius, 0) == actual.getColor(30, 23 - radius, 0));
+}
+
+TEST_CASE("Gaussian convolution preserves constant images", "[gaussian]") {
+    sift::Image image(32, 16, 1);
+    for (int y = 0; y < image.getHeight(); ++y) {
+        for (int x = 0; x < image.getWidth(); ++x) {
+            image.setColor(0.25f, x, y, 0);
+        }
+    }
+
+    sift::convolveGaussian2DInPlace(sift::create2DGaussian(3.0f), &image);
+    for (int y = 0; y < image.getHeight(); ++y) {
+        for (int x = 0; x < image.getWidth(); ++x) {
+            REQUIRE(image.getColor(x, y, 0) == Approx(0.25f));
+        }
+    }
+}
+
+TEST_CASE("Gaussian kernel radius limits", "[gaussian]") {
+    const sift::Gaussian2D identity;
+    CHECK(identity.getRadius() == 0);
+    CHECK(identity.getTaps()[0] == 1.0f);
+
+    const float maxStddev = sift::kMaxGaussianRadius / sift::kDefaultGaussianTruncation;
+    CHECK(sift::create2DGaussian(maxStddev).getRadius() == sift::kMaxGaussianRadius);
+    REQUIRE_THROWS_AS(sift::create2DGaussian(2.0f * maxStddev), std::invalid_argument);
+}
+
+TEST_CASE("Gaussian kernel cache", "[gaussian]") {
+    sift::GaussianKernelCache cache;
+    CHECK(cache.size() == 0);
+
+    const sift::Gaussian2D gaussian = cache.get(1.6f);
+    CHECK(cache.size() == 1);
+    CHECK(cache.get(1.6f).getTaps()[0] == gaussian.getTaps()[0]);
+    CHECK(cache.size() == 1);
+
+    cache.get(1.6f, 3.0f);
+    CHECK(cache.size() == 2);
+    CHECK(cache.get(1.6f, 3.0f).getRadius() == 5);
+
+    cache.clear();
+    CHECK(cache.size() == 0);
+
+    cache.precompute(3, 1.6f);
+    CHECK(cache.size() == sift::computeIncrementalStddevs(3, 1.6f).size());
+}
+
+TEST_CASE("Incremental Gaussian std devs", "[gaussian]") {
+    const int intervals = 3;
+    const std::vector<float> stddevs = sift::computeIncrementalStddevs(intervals, 1.6f);
+    REQUIRE(stddevs.size() == intervals + 3);
+    CHECK(stddevs[0] * stddevs[0] + 0.25f == Approx(1.6f * 1.6f));
+
+    // Applying every increment in sequence must reach sigma_i = 1.6 * 2^(i / intervals).
+    double accumulated = 1.6 * 1.6;
+    for (int i = 1; i < intervals + 3; ++i) {
+        accumulated += stddevs[i] * stddevs[i];
+        CHECK(std::sqrt(accumulated) == Approx(1.6 * std::pow(2.0, static_cast<double>(i) / intervals)));
+    }
+
+    REQUIRE_THROWS_AS(sift::computeIncrementalStddevs(0, 1.6f), std::invalid_argument);
+}
+
+TEST_CASE("Recursive Gaussian approximates the FIR Gaussian", "[gaussian]") {
+    const float stddev = 4.0f;
+    const sift::Gaussian2D recursive = sift::create2DRecursiveGaussian(stddev);
+    CHECK(recursive.getMode() == sift::GaussianFilterMode::Recursive);
+    CHECK(sift::create2DRecursiveGaussian(0.25f).getMode() == sift::GaussianFilterMode::FIR);
+
+    sift::Image image(45, 38, 2);
+    for (int y = 0; y < image.getHeight(); ++y) {
+        for (int x = 0; x < image.getWidth(); ++x) {
+            image.setColor(0.75f, x, y, 0);
+            image.setColor(x < 20 ? 0.0f : 1.0f, x, y, 1);
+        }
+    }
+
+    const sift::Image expected = sift::convolveGaussian2D(sift::create2DGaussian(stddev), image);
+    sift::convolveGaussian2DInPlace(recursive, &image);
+    for (int y = 0; y < image.getHeight(); ++y) {
+        for (int x = 0; x < image.getWidth(); ++x) {
+            REQUIRE(image.getColor(x, y, 0) == Approx(0.75f));
+            REQUIRE(image.getColor(x, y, 1) == Approx(expected.getColor(x, y, 1)).margin(2e-2));
+        }
+    }
+}
+
+TEST_CASE("DoG pyramid layout", "[gaussian]") {
+    const sift::Image image = createRandomImage(64, 48, 1);
+
+    SECTION("two intervals") {
+        const sift::DoGScaleSpacePyramid pyramid(image, 3, 1.6f, 2);
+        CHECK(pyramid.getOctaves() == 3);
+        CHECK(pyramid.getIntervals() == 2);
+        CHECK(pyramid.getDoGsPerOctave() == 4);
+        for (int o = 0; o < pyramid.getOctaves(); ++o) {
+            for (int s = 0; s < pyramid.getDoGsPerOctave(); ++s) {
+                CHECK(pyramid.getDoG(o, s).getWidth() == (64 >> o));
+                CHECK(pyramid.getDoG(o, s).getHeight() == (48 >> o));
+            }
+        }
+    }
+
+    SECTION("five intervals") {
+        const sift::DoGScaleSpacePyramid pyramid(image, 2, 1.6f, 5);
+        CHECK(pyramid.getDoGsPerOctave() == 7);
+        CHECK(pyramid.getDoG(1, 6).getWidth() == 32);
+    }
+
+    REQUIRE_THROWS_AS(sift::DoGScaleSpacePyramid(image, 2, 1.6f, 0), std::invalid_argument);
+}
+
+TEST_CASE("DoG pyramid octave selection", "[gaussian]") {
+    const sift::Image image = createRandomImage(64, 48, 1);
+
+    // 48 -> 24 -> 12 and one more octave would be smaller than kMinOctaveSize.
+    const sift::DoGScaleSpacePyramid automatic(image);
+    CHECK(automatic.getOctaves() == 3);
+    CHECK(automatic.getFirstOctave() == 0);
+
+    const size_t fullSize = sift::DoGScaleSpacePyramid::estimateMemory(64, 48, 1, 3, 3);
+    const sift::DoGScaleSpacePyramid budgeted(image, -1, 1.6f, 3, sift::GaussianFilterMode::FIR, fullSize - 1);
+    CHECK(budgeted.getFirstOctave() == 1);
+    CHECK(budgeted.getOctaves() == 2);
+    CHECK(budgeted.getDoG(0, 0).getWidth() == 32);
+    CHECK(budgeted.getDoG(0, 0).getHeight() == 24);
+    CHECK(sift::DoGScaleSpacePyramid::estimateMemory(32, 24, 1, 2, 3) < fullSize);
+
+    // Away from the borders, where repeated clamping differs from clamping once, the skipped
+    // octave has to produce the same seed as building it would have.
+    const sift::ConstImageView expected = automatic.getDoG(1, 2);
+    const sift::ConstImageView actual = budgeted.getDoG(0, 2);
+    for (int y = 8; y < expected.getHeight() - 8; ++y) {
+        for (int x = 8; x < expected.getWidth() - 8; ++x) {
+            REQUIRE(actual.getColor(x, y, 0) == Approx(expected.getColor(x, y, 0)).margin(1e-3));
+        }
+    }
+
+    // Planar inputs give the same pyramid, also when the first octave is skipped.
+    const sift::Image planar = sift::convertPixelLayout(image, sift::PixelLayout::Planar);
+    const sift::DoGScaleSpacePyramid planarAutomatic(planar);
+    const sift::DoGScaleSpacePyramid planarBudgeted(planar, -1, 1.6f, 3, sift::GaussianFilterMode::FIR, fullSize - 1);
+    for (int s = 0; s < automatic.getDoGsPerOctave(); ++s) {
+        const sift::ConstImageView a = automatic.getDoG(0, s);
+        const sift::ConstImageView b = budgeted.getDoG(0, s);
+        REQUIRE(std::equal(a.getData(), a.getData() + a.getBufferSize(), planarAutomatic.getDoG(0, s).getData()));
+        REQUIRE(std::equal(b.getData(), b.getData() + b.getBufferSize(), planarBudgeted.getDoG(0, s).getData()));
+    }
+
+    REQUIRE_THROWS_AS(sift::DoGScaleSpacePyramid(image, -1, 1.6f, 3, sift::GaussianFilterMode::FIR, 16),
+                      std::invalid_argument);
+    REQUIRE_THROWS_AS(sift::DoGScaleSpacePyramid(image, 8), std::invalid_argument);
+}
+
+TEST_CASE("DoG pyramid from other pixel types", "[gaussian]") {
+    std::mt19937 gen(4321);
+    std::uniform_int_distribution<int> dist(0, 255);
+    sift::Image8 bytes(45, 33, 3);
+    for (int y = 0; y < bytes.getHeight(); ++y) {
+        for (int x = 0; x < bytes.getWidth(); ++x) {
+            for (int c = 0; c < bytes.getChannels(); ++c) {
+                bytes.setColor(static_cast<uint8_t>(dist(gen)), x, y, c);
+            }
+        }
+    }
+    const sift::Image floats = sift::convertPixelType<float>(bytes);
+    const sift::ImageHalf halfs = sift::convertPixelType<sift::half>(floats);
+
+    // The first blur converts the bytes the same way convertPixelType does, so the pyramids are equal.
+    const size_t fullSize = sift::DoGScaleSpacePyramid::estimateMemory(45, 33, 3, 2, 3);
+    for (sift::GaussianFilterMode mode : { sift::GaussianFilterMode::FIR, sift::GaussianFilterMode::Recursive }) {
+        for (size_t budget : { static_cast<size_t>(0), fullSize - 1 }) {
+            const sift::DoGScaleSpacePyramid expected(floats, 2, 1.6f, 3, mode, budget);
+            const sift::DoGScaleSpacePyramid fromBytes(bytes.getView(), 2, 1.6f, 3, mode, budget);
+            sift::DoGScaleSpacePyramid fromChannel(bytes.getView().getChannel(1), 2, 1.6f, 3, mode, budget);
+            const sift::DoGScaleSpacePyramid expectedChannel(sift::Image(floats.getView().getChannel(1)), 2, 1.6f, 3,
+                                                             mode, budget);
+            REQUIRE(fromBytes.getOctaves() == expected.getOctaves());
+            REQUIRE(fromBytes.getFirstOctave() == expected.getFirstOctave());
+            for (int o = 0; o < expected.getOctaves(); ++o) {
+                for (int s = 0; s < expected.getDoGsPerOctave(); ++s) {
+                    const sift::ConstImageView a = expected.getDoG(o, s);
+                    const sift::ConstImageView b = fromBytes.getDoG(o, s);
+                    REQUIRE(std::equal(a.getData(), a.getData() + a.getBufferSize(), b.getData()));
+                    const sift::ConstImageView c = expectedChannel.getDoG(o, s);
+                    const sift::ConstImageView d = fromChannel.getDoG(o, s);
+                    REQUIRE(std::equal(c.getData(), c.getData() + c.getBufferSize(), d.getData()));
+                }
+            }
+
+            // Half inputs only differ by the rounding of the input.
+            fromChannel.rebuild(halfs.getView());
+            for (int s = 0; s < expected.getDoGsPerOctave(); ++s) {
+                const sift::ConstImageView a = expected.getDoG(0, s);
+                const sift::ConstImageView b = fromChannel.getDoG(0, s);
+                for (size_t i = 0; i < a.getBufferSize(); ++i) {
+                    REQUIRE(b.getData()[i] == Approx(a.getData()[i]).margin(1e-3));
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("DoG pyramid with an upsampled first octave", "[gaussian]") {
+    const sift::Image image = createRandomImage(33, 25, 2);
+    const sift::DoGScaleSpacePyramid pyramid(image, -1, 1.6f, 3, sift::GaussianFilterMode::FIR, 0, true);
+
+    // 50 -> 25 -> 12 and the same octaves as without upsampling after the first one.
+    const sift::DoGScaleSpacePyramid regular(image);
+    CHECK(pyramid.getFirstOctave() == -1);
+    REQUIRE(pyramid.getOctaves() == regular.getOctaves() + 1);
+    CHECK(pyramid.getDoG(0, 0).getWidth() == 66);
+    CHECK(pyramid.getDoG(0, 0).getHeight() == 50);
+    CHECK(pyramid.getDoG(1, 0).getWidth() == 33);
+
+    // The fused pass has to match upsampling with resampleImage and blurring from the doubled
+    // assumed blur of the input.
+    const std::vector<float> stddevs = sift::computeIncrementalStddevs(3, 1.6f, 2.0f * sift::kAssumedInputStddev);
+    const sift::Image upsampled = sift::resampleImage(image, 0.5f, 0.5f, sift::ResampleMode::Bilinear);
+    const sift::Image first = sift::convolveGaussian2D(sift::create2DGaussian(stddevs[0]), upsampled);
+    const sift::Image second = sift::convolveGaussian2D(sift::create2DGaussian(stddevs[1]), first);
+    const sift::Image expected = second - first;
+    const sift::ConstImageView actual = pyramid.getDoG(0, 0);
+    for (int y = 0; y < expected.getHeight(); ++y) {
+        for (int x = 0; x < expected.getWidth(); ++x) {
+            for (int c = 0; c < expected.getChannels(); ++c) {
+                REQUIRE(actual.getColor(x, y, c) == Approx(expected.getColor(x, y, c)).margin(1e-5));
+            }
+        }
+    }
+
+    // Other pixel types and layouts are converted before the fused pass and rebuilding reuses it.
+    sift::DoGScaleSpacePyramid planar(sift::convertPixelLayout(image, sift::PixelLayout::Planar), -1, 1.6f, 3,
+                                      sift::GaussianFilterMode::FIR, 0, true);
+    const sift::Image8 bytes = sift::convertPixelType<uint8_t>(image);
+    const sift::DoGScaleSpacePyramid fromBytes(bytes.getView(), -1, 1.6f, 3, sift::GaussianFilterMode::FIR, 0, true);
+    const sift::DoGScaleSpacePyramid expectedBytes(sift::convertPixelType<float>(bytes), -1, 1.6f, 3,
+                                                   sift::GaussianFilterMode::FIR, 0, true);
+    for (int o = 0; o < pyramid.getOctaves(); ++o) {
+        for (int s = 0; s < pyramid.getDoGsPerOctave(); ++s) {
+            const sift::ConstImageView a = pyramid.getDoG(o, s);
+            REQUIRE(std::equal(a.getData(), a.getData() + a.getBufferSize(), planar.getDoG(o, s).getData()));
+            const sift::ConstImageView b = expectedBytes.getDoG(o, s);
+            REQUIRE(std::equal(b.getData(), b.getData() + b.getBufferSize(), fromBytes.getDoG(o, s).getData()));
+        }
+    }
+    planar.rebuild(image);
+    const sift::ConstImageView rebuilt = planar.getDoG(0, 1);
+    REQUIRE(std::equal(rebuilt.getData(), rebuilt.getData() + rebuilt.getBufferSize(), pyramid.getDoG(0, 1).getData()));
+
+    // The memory budget drops the upsampled octave first, which leaves the regular pyramid.
+    const size_t fullSize = sift::DoGScaleSpacePyramid::estimateMemory(66, 50, 2, pyramid.getOctaves(), 3);
+    const sift::DoGScaleSpacePyramid budgeted(image, -1, 1.6f, 3, sift::GaussianFilterMode::FIR, fullSize - 1, true);
+    CHECK(budgeted.getFirstOctave() == 0);
+    REQUIRE(budgeted.getOctaves() == regular.getOctaves());
+    const sift::ConstImageView a = regular.getDoG(0, 2);
+    REQUIRE(std::equal(a.getData(), a.getData() + a.getBufferSize(), budgeted.getDoG(0, 2).getData()));
+
+    REQUIRE_THROWS_AS(sift::DoGScaleSpacePyramid(image, -1, 1.0f, 3, sift::GaussianFilterMode::FIR, 0, true),
+                      std::invalid_argument);
+}
+
+TEST_CASE("DoG pyramid values", "[gaussian]") {
+    const sift::Image image = createRandomImage(40, 36, 2);
+    const std::vector<float> stddevs = sift::computeIncrementalStddevs(2, 1.6f);
+    const sift::DoGScaleSpacePyramid pyramid(image, 2, 1.6f, 2);
+
+    // Build the first octave and the seed of the second one with the Image API.
+    sift::Image prevScaleImage = sift::convolveGaussian2D(sift::create2DGaussian(stddevs[0]), image);
+    sift::Image nextOctaveImage;
+    for (int s = 1; s < 5; ++s) {
+        const sift::Image currScaleImage = sift::convolveGaussian2D(sift::create2DGaussian(stddevs[s]), prevScaleImage);
+        const sift::Image expected = currScaleImage - prevScaleImage;
+        const sift::ConstImageView actual = pyramid.getDoG(0, s - 1);
+        for (int y = 0; y < image.getHeight(); ++y) {
+            for (int x = 0; x < image.getWidth(); ++x) {
+                for (int c = 0; c < image.getChannels(); ++c) {
+                    REQUIRE(actual.getColor(x, y, c) == Approx(expected.getColor(x, y, c)).margin(1e-6));
+                }
+            }
+        }
+
+        if (s == 2) {
+            nextOctaveImage = sift::resampleImage(currScaleImage, 2, 2);
+        }
+        prevScaleImage = currScaleImage;
+    }
+
+    const sift::Image expected = sift::convolveGaussian2D(sift::create2DGaussian(stddevs[1]), nextOctaveImage) - nextOctaveImage;
+    const sift::ConstImageView actual = pyramid.getDoG(1, 0);
+    REQUIRE(actual.getWidth() == expected.getWidth());
+    for (int y = 0; y < expected.getHeight(); ++y) {
+        for (int x = 0; x < expected.getWidth(); ++x) {
+            for (int c = 0; c < expected.getChannels(); ++c) {
+                REQUIRE(actual.getColor(x, y, c) == Approx(expected.getColor(x, y, c)).margin(1e-6));
+            }
+        }
+    }
+}
+
+TEST_CASE("Recursive DoG pyramid values", "[gaussian]") {
+    const sift::Image image = createRandomImage(40, 36, 3);
+    const std::vector<float> stddevs = sift::computeIncrementalStddevs(3, 1.6f);
+    const sift::DoGScaleSpacePyramid pyramid(image, 1, 1.6f, 3, sift::GaussianFilterMode::Recursive);
+
+    sift::Image prevScaleImage = sift::convolveGaussian2D(
+        sift::create2DGaussian(stddevs[0], sift::GaussianFilterMode::Recursive), image);
+    for (int s = 1; s < 6; ++s) {
+        const sift::Image currScaleImage = sift::convolveGaussian2D(
+            sift::create2DGaussian(stddevs[s], sift::GaussianFilterMode::Recursive), prevScaleImage);
+        const sift::Image expected = currScaleImage - prevScaleImage;
+        const sift::ConstImageView actual = pyramid.getDoG(0, s - 1);
+        for (int y = 0; y < image.getHeight(); ++y) {
+            for (int x = 0; x < image.getWidth(); ++x) {
+                for (int c = 0; c < image.getChannels(); ++c) {
+                    REQUIRE(actual.getColor(x, y, c) == Approx(expected.getColor(x, y, c)).margin(1e-6));
+                }
+            }
+        }
+        prevScaleImage = currScaleImage;
+    }
+}
+
+TEST_CASE("DoG pyramid rebuild", "[gaussian]") {
+    const sift::Image first = createRandomImage(48, 40, 1);
+    sift::Image second = first;
+    sift::convolveGaussian2DInPlace(sift::create2DGaussian(1.0f), &second);
+
+    sift::DoGScaleSpacePyramid pyramid(first, 3, 1.6f, 2);
+    const float* levelData = pyramid.getDoG(1, 1).getData();
+
+    pyramid.rebuild(second);
+    CHECK(pyramid.getDoG(1, 1).getData() == levelData);
+
+    const sift::DoGScaleSpacePyramid expected(second, 3, 1.6f, 2);
+    for (int o = 0; o < expected.getOctaves(); ++o) {
+        for (int s = 0; s < expected.getDoGsPerOctave(); ++s) {
+            const sift::ConstImageView a = pyramid.getDoG(o, s);
+            const sift::ConstImageView b = expected.getDoG(o, s);
+            REQUIRE(std::equal(a.getData(), a.getData() + a.getBufferSize(), b.getData()));
+        }
+    }
+
+    // The layout of the input rows does not matter.
+    const sift::DoGScaleSpacePyramid packed(first, 3, 1.6f, 2);
+    const sift::DoGScaleSpacePyramid padded(createRandomImage(48, 40, 1, sift::RowPadding::CacheLine), 3, 1.6f, 2);
+    for (int o = 0; o < padded.getOctaves(); ++o) {
+        for (int s = 0; s < padded.getDoGsPerOctave(); ++s) {
+            const sift::ConstImageView a = padded.getDoG(o, s);
+            const sift::ConstImageView b = packed.getDoG(o, s);
+            REQUIRE(std::equal(a.getData(), a.getData() + a.getBufferSize(), b.getData()));
+        }
+    }
+
+    pyramid.rebuild(createRandomImage(24, 20, 1));
+    CHECK(pyramid.getDoG(0, 0).getWidth() == 24);
+    CHECK(pyramid.getDoG(2, 0).getHeight() == 5);
+}
@@ -7,8 +7,17 @@
 #include <boost/filesystem.hpp>
 #define CATCH_CONFIG_MAIN 
 #include "catch.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <vector>
+#include "elementwise.h"
 #include "image.h"
+#include "parallel.h"
 #include <iostream>
 
 namespace bfs = boost::filesystem;
@@ -58,6 +67,22 @@ TEST_CASE("Image read write equivalence", "[imageio]") {
     image.saveToFile(outFname);
     cmpImage.loadFromFile(outFname);
     REQUIRE(image == cmpImage);
+
+    // Planar images are split into planes while decoding and merged again while encoding.
+    sift::Image planarImage;
+    planarImage.loadFromFile(outFname, sift::PixelLayout::Planar);
+    REQUIRE(planarImage.getPixelLayout() == sift::PixelLayout::Planar);
+    REQUIRE(planarImage == image);
+    planarImage.saveToFile(outFname);
+    cmpImage.loadFromFile(outFname);
+    REQUIRE(cmpImage.getPixelLayout() == sift::PixelLayout::Interleaved);
+    REQUIRE(cmpImage == image);
+
+    // 8-bit files decode into a quarter of the memory and convert to the same floats.
+    sift::Image8 byteImage;
+    byteImage.loadFromFile(outFname);
+    REQUIRE(byteImage.getBufferSize() == image.getBufferSize());
+    REQUIRE(sift::convertPixelType<float>(byteImage) == image);
     bfs::remove(bfs::path(outFname));
 }
 
@@ -99,3 +124,682 @@ TEST_CASE("Image IO Failure", "[imageio]") {
     REQUIRE_THROWS_AS(image.loadFromFile("THIS_SHOULD_FAIL.HELLO"), sift::ImageIOException);
     REQUIRE_THROWS_AS(image.loadFromFile(""), sift::ImageIOException);
 }
+
+TEST_CASE("Image grayscale load", "[imageio]") {
+    bfs::path tmpPath = bfs::unique_path();
+    std::string outFname = tmpPath.native() + ".png";
+
+    // PNG stores 8 bits per channel, so multiples of 1/255 survive the round trip exactly.
+    sift::Image color(13, 7, 3);
+    for (int y = 0; y < color.getHeight(); ++y) {
+        for (int x = 0; x < color.getWidth(); ++x) {
+            for (int c = 0; c < 3; ++c) {
+                color.setColor(static_cast<float>((x * 37 + y * 11 + c * 91) % 256) / 255.0f, x, y, c);
+            }
+        }
+    }
+    color.saveToFile(outFname);
+
+    sift::Image gray;
+    gray.loadFromFileAsGrayscale(outFname);
+    REQUIRE(gray.getWidth() == 13);
+    REQUIRE(gray.getHeight() == 7);
+    REQUIRE(gray.getChannels() == 1);
+    for (int y = 0; y < color.getHeight(); ++y) {
+        for (int x = 0; x < color.getWidth(); ++x) {
+            const float expected = 0.2126f * color.getColor(x, y, 0) + 0.7152f * color.getColor(x, y, 1) +
+                                   0.0722f * color.getColor(x, y, 2);
+            CHECK(gray.getColor(x, y, 0) == Approx(expected).margin(1e-6));
+        }
+    }
+
+    SECTION("weights") {
+        gray.loadFromFileAsGrayscale(outFname, sift::GrayscaleWeights(0.0f, 0.0f, 1.0f));
+        for (int y = 0; y < color.getHeight(); ++y) {
+            for (int x = 0; x < color.getWidth(); ++x) {
+                CHECK(gray.getColor(x, y, 0) == color.getColor(x, y, 2));
+            }
+        }
+    }
+
+    SECTION("integer pixels") {
+        // The luminance is computed in float and only rounded once.
+        sift::Image8 byteGray;
+        byteGray.loadFromFileAsGrayscale(outFname);
+        REQUIRE(byteGray.getChannels() == 1);
+        CHECK(sift::convertPixelType<uint8_t>(gray) == byteGray);
+    }
+
+    SECTION("gray files") {
+        gray.saveToFile(outFname);
+        sift::Image grayAgain;
+        grayAgain.loadFromFileAsGrayscale(outFname, sift::GrayscaleWeights(0.0f, 0.0f, 1.0f));
+        sift::Image8 byteGray;
+        byteGray.loadFromFile(outFname);
+        CHECK(sift::convertPixelType<uint8_t>(grayAgain) == byteGray);
+    }
+    bfs::remove(bfs::path(outFname));
+
+    REQUIRE_THROWS_AS(gray.loadFromFileAsGrayscale("THIS_SHOULD_FAIL.HELLO"), sift::ImageIOException);
+}
+
+TEST_CASE("Image streaming load", "[imageio]") {
+    bfs::path tmpPath = bfs::unique_path();
+    std::string outFname = tmpPath.native() + ".png";
+
+    // Tall enough to be decoded in several bands.
+    sift::Image image(11, 53, 3);
+    for (int y = 0; y < image.getHeight(); ++y) {
+        for (int x = 0; x < image.getWidth(); ++x) {
+            for (int c = 0; c < 3; ++c) {
+                image.setColor(static_cast<float>((x * 29 + y * 13 + c * 71) % 256) / 255.0f, x, y, c);
+            }
+        }
+    }
+    image.saveToFile(outFname);
+
+    sift::Image loaded;
+    loaded.loadFromFile(outFname);
+    REQUIRE(loaded == image);
+
+    sift::Image planar;
+    planar.loadFromFile(outFname, sift::PixelLayout::Planar);
+    REQUIRE(planar == image);
+
+    // Every row arrives exactly once, from top to bottom.
+    sift::Image streamed(11, 53, 3);
+    int nextRow = 0;
+    bool inOrder = true;
+    sift::streamImageFromFile<float>(outFname, [&](const sift::ConstImageView& rows, int y) {
+        inOrder = inOrder && (y == nextRow) && (rows.getWidth() == 11) && (rows.getChannels() == 3);
+        nextRow = y + rows.getHeight();
+        for (int row = 0; row < rows.getHeight(); ++row) {
+            for (int x = 0; x < rows.getWidth(); ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    streamed.setColor(rows.getRowPointer(row)[x * rows.getPixelStride() + c], x, y + row, c);
+                }
+            }
+        }
+    });
+    CHECK(inOrder);
+    CHECK(nextRow == 53);
+    CHECK(streamed == image);
+    bfs::remove(bfs::path(outFname));
+
+    REQUIRE_THROWS_AS(sift::streamImageFromFile<uint8_t>("THIS_SHOULD_FAIL.HELLO",
+                                                         [](const sift::BasicImageView<const uint8_t>&, int) {}),
+                      sift::ImageIOException);
+}
+
+namespace
+{
+
+sift::Image createRampImage(int width, int height, int channels, float offset)
+{
+    sift::Image image(width, height, channels);
+    for (size_t i = 0; i < image.getBufferSize(); ++i) {
+        image.getData()[i] = offset + 0.25f * static_cast<float>(i);
+    }
+    return image;
+}
+
+}
+
+TEST_CASE("Image arithmetic", "[image]") {
+    const sift::Image a = createRampImage(7, 5, 3, 1.0f);
+    const sift::Image b = createRampImage(7, 5, 3, -2.0f);
+    const sift::Image c = createRampImage(7, 5, 3, 0.5f);
+
+    const sift::Image sum = a + b - c;
+    const sift::Image scaled = 2 * a - b;
+    const sift::Image negated = -a;
+    REQUIRE(sum.getWidth() == 7);
+    REQUIRE(sum.getHeight() == 5);
+    REQUIRE(sum.getChannels() == 3);
+    for (size_t i = 0; i < a.getBufferSize(); ++i) {
+        CHECK(sum.getData()[i] == a.getData()[i] + b.getData()[i] - c.getData()[i]);
+        CHECK(scaled.getData()[i] == 2.0f * a.getData()[i] - b.getData()[i]);
+        CHECK(negated.getData()[i] == -a.getData()[i]);
+    }
+
+    sift::Image d = a;
+    d += b;
+    d -= c;
+    CHECK(d == sum);
+
+    // The destination may also be an operand.
+    d = d - 0.5f * d;
+    for (size_t i = 0; i < d.getBufferSize(); ++i) {
+        CHECK(d.getData()[i] == sum.getData()[i] - 0.5f * sum.getData()[i]);
+    }
+
+    sift::Image e;
+    e = a - a;
+    CHECK(e.getBufferSize() == a.getBufferSize());
+    CHECK(e == sift::Image(7, 5, 3));
+    CHECK(e != a);
+}
+
+TEST_CASE("Element-wise array operations", "[image]") {
+    // Odd sizes and offsets exercise the unaligned loads and the scalar tails.
+    std::vector<float> x(67);
+    std::vector<float> y(67);
+    for (size_t i = 0; i < x.size(); ++i) {
+        x[i] = 0.5f * static_cast<float>(i) - 7.0f;
+        y[i] = 3.0f - 0.25f * static_cast<float>(i * i % 13);
+    }
+
+    for (size_t offset = 0; offset < 3; ++offset) {
+        for (size_t count = 0; count + offset <= x.size(); count += 5) {
+            const float* a = x.data() + offset;
+            const float* b = y.data() + offset;
+            std::vector<float> dst(count + 1, 42.0f);
+
+            sift::detail::addArrays(a, b, dst.data(), count);
+            for (size_t i = 0; i < count; ++i) {
+                REQUIRE(dst[i] == a[i] + b[i]);
+            }
+            sift::detail::subtractArrays(a, b, dst.data(), count);
+            for (size_t i = 0; i < count; ++i) {
+                REQUIRE(dst[i] == a[i] - b[i]);
+            }
+            sift::detail::negateArray(a, dst.data(), count);
+            for (size_t i = 0; i < count; ++i) {
+                REQUIRE(dst[i] == -a[i]);
+            }
+            sift::detail::scaleArray(1.5f, a, dst.data(), count);
+            for (size_t i = 0; i < count; ++i) {
+                REQUIRE(dst[i] == 1.5f * a[i]);
+            }
+            sift::detail::axpbyArrays(2.0f, a, -0.5f, b, dst.data(), count);
+            for (size_t i = 0; i < count; ++i) {
+                REQUIRE(dst[i] == Approx(2.0f * a[i] - 0.5f * b[i]));
+            }
+            REQUIRE(dst[count] == 42.0f);
+
+            REQUIRE(sift::detail::equalArrays(a, a, count));
+            for (size_t i = 0; i < count; ++i) {
+                std::vector<float> changed(a, a + count);
+                changed[i] = std::nextafter(changed[i], 100.0f);
+                REQUIRE_FALSE(sift::detail::equalArrays(a, changed.data(), count));
+            }
+        }
+    }
+
+    const float zeros[] = { 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f };
+    const float signs[] = { -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f, 0.0f, -0.0f };
+    CHECK(sift::detail::equalArrays(zeros, signs, 9));
+    const float nans[] = { NAN, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f };
+    CHECK_FALSE(sift::detail::equalArrays(nans, nans, 9));
+}
+
+TEST_CASE("Image row padding", "[image]") {
+    sift::Image padded(10, 20, 3, sift::RowPadding::CacheLine);
+    CHECK(padded.getRowPadding() == sift::RowPadding::CacheLine);
+    CHECK(padded.getStride() == 32);
+    CHECK(padded.getBufferSize() == 640);
+    CHECK(padded.getRowPointer(1) - padded.getData() == 32);
+    for (int y = 0; y < padded.getHeight(); ++y) {
+        CHECK(reinterpret_cast<uintptr_t>(padded.getRowPointer(y)) % 64 == 0);
+    }
+
+    // Strides of a multiple of 4096 bytes get one more cache line.
+    CHECK(sift::Image::computeStride(1024, 1, sift::RowPadding::CacheLine) == 1040);
+    CHECK(sift::Image::computeStride(1024, 1, sift::RowPadding::None) == 1024);
+    CHECK(sift::Image::computeStride(10, 3, sift::RowPadding::None) == 30);
+
+    // The padding is kept when resizing unless asked otherwise.
+    padded.resizeImage(5, 4, 1);
+    CHECK(padded.getStride() == 16);
+    padded.resizeImage(10, 20, 3);
+
+    sift::Image packed(10, 20, 3);
+    for (int y = 0; y < packed.getHeight(); ++y) {
+        for (int x = 0; x < packed.getWidth(); ++x) {
+            for (int c = 0; c < packed.getChannels(); ++c) {
+                const float value = static_cast<float>(x) - 2.0f * static_cast<float>(y) + 0.5f * static_cast<float>(c);
+                packed.setColor(value, x, y, c);
+                padded.setColor(value, x, y, c);
+            }
+        }
+    }
+    CHECK(padded.getColor(7, 13, 2) == packed.getColor(7, 13, 2));
+    CHECK(padded == packed);
+    CHECK(packed == padded);
+
+    // Expressions mix layouts and write into the layout of the destination.
+    sift::Image result(10, 20, 3, sift::RowPadding::CacheLine);
+    result = 2 * padded - packed + padded;
+    CHECK(result.getStride() == 32);
+    const sift::Image expected = 2 * packed;
+    CHECK(result == expected);
+    CHECK(expected.getStride() == 30);
+}
+
+TEST_CASE("Planar image layout", "[image]") {
+    const sift::Image interleaved = createRampImage(7, 5, 3, 1.0f);
+    CHECK(interleaved.getPixelLayout() == sift::PixelLayout::Interleaved);
+    CHECK(interleaved.getPixelStride() == 3);
+    CHECK(interleaved.getChannelStride() == 1);
+
+    const sift::Image planar = sift::convertPixelLayout(interleaved, sift::PixelLayout::Planar);
+    CHECK(planar.getPixelLayout() == sift::PixelLayout::Planar);
+    CHECK(planar.getStride() == 7);
+    CHECK(planar.getPixelStride() == 1);
+    CHECK(planar.getChannelStride() == 35);
+    CHECK(planar.getBufferSize() == interleaved.getBufferSize());
+    CHECK(planar.getRowPointer(2, 1) - planar.getData() == 35 + 2 * 7);
+    for (int y = 0; y < 5; ++y) {
+        for (int x = 0; x < 7; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                REQUIRE(planar.getColor(x, y, c) == interleaved.getColor(x, y, c));
+                REQUIRE(planar.getRowPointer(y, c)[x] == interleaved.getRowPointer(y, c)[3 * x]);
+            }
+        }
+    }
+    CHECK(planar == interleaved);
+    CHECK(sift::convertPixelLayout(planar, sift::PixelLayout::Interleaved) == interleaved);
+
+    // Every plane of a padded planar image is padded.
+    const sift::Image padded(7, 5, 3, sift::RowPadding::CacheLine, sift::PixelLayout::Planar);
+    CHECK(padded.getStride() == 16);
+    CHECK(padded.getChannelStride() == 80);
+    CHECK(padded.getBufferSize() == 240);
+    CHECK(reinterpret_cast<uintptr_t>(padded.getRowPointer(3, 2)) % 64 == 0);
+
+    // Expressions keep the layout of their operands.
+    const sift::Image planarB = sift::convertPixelLayout(createRampImage(7, 5, 3, -2.0f), sift::PixelLayout::Planar);
+    sift::Image sum = planar + 2 * planarB;
+    CHECK(sum.getPixelLayout() == sift::PixelLayout::Planar);
+    CHECK(sum == interleaved + 2 * createRampImage(7, 5, 3, -2.0f));
+    sum += planar;
+    CHECK(sum.getColor(4, 3, 2) == 2 * planar.getColor(4, 3, 2) + 2 * planarB.getColor(4, 3, 2));
+
+    sift::Image changed = planar;
+    changed.setColor(0.0f, 6, 4, 2);
+    CHECK(changed != interleaved);
+}
+
+TEST_CASE("Image views", "[image]") {
+    sift::Image image = createRampImage(9, 6, 3, 1.0f);
+    const sift::ConstImageView view = image;
+    CHECK(view.getData() == image.getData());
+    CHECK(view.getStride() == 27);
+    CHECK(view.getPixelStride() == 3);
+    CHECK(view.getChannelStride() == 1);
+    CHECK(view.isPacked());
+    CHECK(view(4, 2, 1) == image.getColor(4, 2, 1));
+
+    // Crops and channels point into the image.
+    const sift::ConstImageView crop = view.crop(2, 1, 5, 4);
+    CHECK(crop.getWidth() == 5);
+    CHECK(crop.getHeight() == 4);
+    CHECK(crop.getData() == image.getRowPointer(1) + 6);
+    CHECK(crop.isInterleaved());
+    CHECK_FALSE(crop.isPacked());
+    const sift::ConstImageView green = crop.getChannel(1);
+    CHECK(green.getChannels() == 1);
+    CHECK(green.getPixelStride() == 3);
+    CHECK_FALSE(green.isInterleaved());
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 5; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                REQUIRE(crop(x, y, c) == image.getColor(x + 2, y + 1, c));
+            }
+            REQUIRE(green(x, y, 0) == image.getColor(x + 2, y + 1, 1));
+        }
+    }
+
+    // Writable views modify the image.
+    image.getView().crop(2, 1, 5, 4)(0, 0, 2) = -1.0f;
+    CHECK(image.getColor(2, 1, 2) == -1.0f);
+
+    // Copies can change the layout.
+    const sift::Image copy(crop, sift::RowPadding::CacheLine, sift::PixelLayout::Planar);
+    CHECK(copy.getWidth() == 5);
+    CHECK(copy.getPixelLayout() == sift::PixelLayout::Planar);
+    CHECK(copy.getColor(0, 0, 2) == -1.0f);
+    sift::Image interleaved(5, 4, 3);
+    sift::copyImageView(copy, interleaved);
+    CHECK(interleaved == copy);
+    CHECK(interleaved.getColor(3, 2, 1) == image.getColor(5, 3, 1));
+
+    // Views of planar images.
+    const sift::Image planar = sift::convertPixelLayout(image, sift::PixelLayout::Planar);
+    const sift::ConstImageView planarView = planar.getView().crop(1, 1, 3, 3);
+    CHECK(planarView.getPixelStride() == 1);
+    CHECK(planarView.getChannelStride() == planar.getChannelStride());
+    CHECK(planarView(2, 2, 2) == image.getColor(3, 3, 2));
+}
+
+TEST_CASE("Image halo", "[image]") {
+    sift::Image image = createRampImage(6, 4, 2, 0.0f);
+    const sift::Image original = image;
+
+    // Reads outside of the image are clamped to the last pixel, not one past it.
+    CHECK(image.getColor(6, 4, 1) == image.getColor(5, 3, 1));
+    CHECK(image.getColor(-1, 9, 0) == image.getColor(0, 3, 0));
+
+    image.setHalo(3);
+    CHECK(image.getHalo() == 3);
+    CHECK(image.getBorderMode() == sift::BorderMode::Replicate);
+    CHECK(image == original);
+    CHECK(image.getBufferSize() == 12 * 10 * 2);
+    for (int y = -3; y < 7; ++y) {
+        for (int x = -3; x < 9; ++x) {
+            for (int c = 0; c < 2; ++c) {
+                REQUIRE(image.getColorUnclamped(x, y, c) == original.getColor(x, y, c));
+            }
+        }
+    }
+
+    // Mirroring repeats the edge pixel, also for halos that are wider than the image.
+    image.setHalo(3, sift::BorderMode::Mirror);
+    CHECK(image == original);
+    CHECK(image.getColorUnclamped(-1, 2, 1) == original.getColor(0, 2, 1));
+    CHECK(image.getColorUnclamped(-3, 2, 1) == original.getColor(2, 2, 1));
+    CHECK(image.getColorUnclamped(7, -2, 0) == original.getColor(4, 1, 0));
+    sift::Image tiny(2, 1, 1);
+    tiny.setColor(1.0f, 0, 0, 0);
+    tiny.setColor(2.0f, 1, 0, 0);
+    tiny.setHalo(5, sift::BorderMode::Mirror);
+    CHECK(tiny.getColorUnclamped(-1, 0, 0) == 1.0f);
+    CHECK(tiny.getColorUnclamped(-3, 0, 0) == 2.0f);
+    CHECK(tiny.getColorUnclamped(-5, 0, 0) == 1.0f);
+    CHECK(tiny.getColorUnclamped(6, -4, 0) == 2.0f);
+
+    // Planar and padded images keep their pixels aligned.
+    sift::Image planar(5, 3, 3, sift::RowPadding::CacheLine, sift::PixelLayout::Planar);
+    planar = sift::convertPixelLayout(createRampImage(5, 3, 3, 1.0f), sift::PixelLayout::Planar);
+    planar.setHalo(2);
+    CHECK(planar.getPixelLayout() == sift::PixelLayout::Planar);
+    CHECK(planar == createRampImage(5, 3, 3, 1.0f));
+    CHECK(planar.getColorUnclamped(-2, -1, 2) == planar.getColor(0, 0, 2));
+    CHECK(planar.getColorUnclamped(6, 4, 1) == planar.getColor(4, 2, 1));
+    sift::Image padded(5, 3, 3, sift::RowPadding::CacheLine);
+    padded.setHalo(2);
+    for (int y = -2; y < 5; ++y) {
+        CHECK(reinterpret_cast<uintptr_t>(padded.getRowPointer(y)) % 64 == 0);
+    }
+
+    // Resizing keeps the halo.
+    image.resizeImage(3, 3, 1);
+    CHECK(image.getHalo() == 3);
+    CHECK(image.getStride() == 9);
+}
+
+TEST_CASE("Half floats", "[image]") {
+    CHECK(sift::half(1.0f).getBits() == 0x3C00);
+    CHECK(sift::half(-2.5f).getBits() == 0xC100);
+    CHECK(sift::half(65504.0f).getBits() == 0x7BFF);
+    CHECK(sift::half(65519.0f).getBits() == 0x7BFF);
+    CHECK(sift::half(65520.0f).getBits() == 0x7C00);
+    CHECK(sift::half(-1e10f).getBits() == 0xFC00);
+    CHECK(std::isnan(static_cast<float>(sift::half(std::nanf("")))));
+
+    // Ties round to the even mantissa.
+    CHECK(sift::half(1.0f + std::ldexp(1.0f, -11)).getBits() == 0x3C00);
+    CHECK(sift::half(1.0f + 3.0f * std::ldexp(1.0f, -11)).getBits() == 0x3C02);
+
+    // Subnormals down to 2^-24 and the switch to normal numbers.
+    CHECK(sift::half(std::ldexp(1.0f, -24)).getBits() == 0x0001);
+    CHECK(sift::half(std::ldexp(1.0f, -26)).getBits() == 0x0000);
+    CHECK(sift::half(std::ldexp(1023.5f, -24)).getBits() == 0x0400);
+    CHECK(sift::half(-std::ldexp(3.0f, -24)).getBits() == 0x8003);
+
+    // Every half that is not a NaN survives the round trip through float.
+    for (uint32_t bits = 0; bits <= 0xFFFF; ++bits) {
+        const sift::half value = sift::half::fromBits(static_cast<uint16_t>(bits));
+        if (!std::isnan(static_cast<float>(value))) {
+            REQUIRE(sift::half(static_cast<float>(value)).getBits() == bits);
+        }
+    }
+}
+
+TEST_CASE("Image pixel types", "[image]") {
+    CHECK(sift::convertPixel<float>(uint8_t(255)) == 1.0f);
+    CHECK(sift::convertPixel<float>(uint16_t(0)) == 0.0f);
+    CHECK(sift::convertPixel<uint8_t>(0.5f) == 128);
+    CHECK(sift::convertPixel<uint8_t>(-1.0f) == 0);
+    CHECK(sift::convertPixel<uint8_t>(2.0f) == 255);
+    CHECK(sift::convertPixel<uint16_t>(uint8_t(255)) == 65535);
+    for (int i = 0; i < 256; ++i) {
+        REQUIRE(sift::convertPixel<uint8_t>(sift::convertPixel<float>(static_cast<uint8_t>(i))) == i);
+    }
+
+    sift::Image8 bytes(5, 4, 3);
+    CHECK(bytes.getBufferSize() == 60);
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 5; ++x) {
+            for (int c = 0; c < 3; ++c) {
+                bytes.setColor(static_cast<uint8_t>(50 * c + 10 * y + x), x, y, c);
+            }
+        }
+    }
+    CHECK(bytes.getColor(4, 3, 2) == 134);
+    CHECK(bytes.getCastedColor(4, 3, 2) == 134);
+    CHECK(bytes.getColor(9, 9, 0) == bytes.getColor(4, 3, 0));
+
+    const sift::Image floats = sift::convertPixelType<float>(bytes);
+    CHECK(floats.getColor(4, 3, 2) == 134.0f / 255.0f);
+    CHECK(sift::convertPixelType<uint8_t>(floats) == bytes);
+
+    const sift::ImageHalf halfs = sift::convertPixelType<sift::half>(floats);
+    CHECK(halfs.getBufferSize() == 60);
+    CHECK(static_cast<float>(halfs.getColor(4, 3, 2)) == Approx(134.0f / 255.0f).epsilon(1e-3));
+
+    // Layouts, halos and views work the same way for every pixel type.
+    sift::Image8 planar = sift::convertPixelLayout(bytes, sift::PixelLayout::Planar);
+    CHECK(planar == bytes);
+    planar.setHalo(2, sift::BorderMode::Mirror);
+    CHECK(planar == bytes);
+    CHECK(planar.getColorUnclamped(-2, 5, 1) == bytes.getColor(1, 2, 1));
+    CHECK(planar.getView().getChannel(2).crop(1, 1, 2, 2).getColor(1, 1, 0) == bytes.getColor(2, 2, 2));
+
+    sift::Image16 words = sift::convertPixelType<uint16_t>(planar);
+    CHECK(words.getPixelLayout() == sift::PixelLayout::Planar);
+    CHECK(words.getHalo() == 2);
+    CHECK(words.getColor(4, 3, 2) == 134 * 257);
+    words += words;
+    CHECK(words.getColor(0, 0, 0) == 0);
+    CHECK(words.getColor(4, 3, 2) == 65535);
+}
+
+TEST_CASE("Image size limits", "[image]") {
+    REQUIRE_THROWS_AS(sift::Image(-1, 2, 3), std::invalid_argument);
+    REQUIRE_THROWS_AS(sift::Image(2, 2, -3), std::invalid_argument);
+
+    // Sizes that do not fit into a size_t are caught before anything is allocated.
+    const int maxSide = std::numeric_limits<int>::max();
+    REQUIRE_THROWS_AS(sift::Image(maxSide, maxSide, maxSide), std::bad_alloc);
+    REQUIRE_THROWS_AS(sift::Image(maxSide, maxSide, maxSide, sift::RowPadding::CacheLine, sift::PixelLayout::Planar),
+                      std::bad_alloc);
+
+    // A failed resize leaves the image as it was.
+    sift::Image image = createRampImage(5, 4, 3, 0.0f);
+    const sift::Image original = image;
+    REQUIRE_THROWS_AS(image.resizeImage(maxSide, maxSide, maxSide), std::bad_alloc);
+    REQUIRE_THROWS_AS(image.resizeImage(-5, 4, 3), std::invalid_argument);
+    CHECK(image == original);
+    CHECK(image.getStride() == 15);
+    REQUIRE_THROWS_AS(image.setHalo(maxSide / 2), std::bad_alloc);
+    CHECK(image.getHalo() == 0);
+    CHECK(image == original);
+}
+
+TEST_CASE("Image resize without initialization", "[image]") {
+    sift::Image image(40, 30, 3);
+    const float* data = image.getData();
+
+    // Shrinking and growing back within the capacity keeps the allocation.
+    image.resizeImageUninitialized(20, 10, 3);
+    CHECK(image.getData() == data);
+    CHECK(image.getWidth() == 20);
+    CHECK(image.getHeight() == 10);
+    CHECK(image.getStride() == 60);
+    image.resizeImageUninitialized(30, 40, 3);
+    CHECK(image.getData() == data);
+
+    // The zero filling resize reuses the allocation as well and still clears every element.
+    image.setColor(1.0f, 3, 4, 2);
+    image.resizeImage(10, 10, 3);
+    CHECK(image.getData() == data);
+    CHECK(image == sift::Image(10, 10, 3));
+
+    // Every element written afterwards is kept, also in the other layouts.
+    sift::Image planar(8, 8, 2, sift::RowPadding::CacheLine, sift::PixelLayout::Planar);
+    planar.setHalo(2);
+    const sift::Image ramp = createRampImage(7, 5, 2, 0.0f);
+    planar.resizeImageUninitialized(7, 5, 2, sift::RowPadding::CacheLine, sift::PixelLayout::Planar);
+    sift::copyImageView(ramp, planar.getView());
+    CHECK(planar == ramp);
+    CHECK(planar.getStride() % 16 == 0);
+    planar.fillHalo();
+    CHECK(planar.getColorUnclamped(-2, -1, 1) == ramp.getColor(0, 0, 1));
+
+    SECTION("buffer") {
+        sift::AlignedBuffer<float> buffer(100);
+        float* const bufferData = buffer.data();
+        buffer.resizeUninitialized(10);
+        CHECK(buffer.size() == 10);
+        CHECK(buffer.capacity() == 100);
+        CHECK(buffer.data() == bufferData);
+
+        std::fill(buffer.data(), buffer.data() + buffer.size(), 2.0f);
+        const sift::AlignedBuffer<float> copy(buffer);
+        CHECK(copy.size() == 10);
+        CHECK(copy.capacity() == 10);
+        CHECK(std::equal(copy.data(), copy.data() + copy.size(), buffer.data()));
+
+        buffer.shrinkToFit();
+        CHECK(buffer.capacity() == 10);
+        CHECK(std::count(buffer.data(), buffer.data() + buffer.size(), 2.0f) == 10);
+
+        buffer.resizeUninitialized(200);
+        CHECK(buffer.capacity() == 200);
+        CHECK(reinterpret_cast<uintptr_t>(buffer.data()) % sift::AlignedBuffer<float>::kAlignment == 0);
+    }
+}
+
+TEST_CASE("Image decimation", "[image]") {
+    // The naive resample that resampleImage used to do for every factor.
+    const auto resampleReference = [](const sift::Image& image, int fx, int fy) {
+        sift::Image resampled(image.getWidth() / fx, image.getHeight() / fy, image.getChannels());
+        for (int y = 0; y < resampled.getHeight(); ++y) {
+            for (int x = 0; x < resampled.getWidth(); ++x) {
+                for (int c = 0; c < resampled.getChannels(); ++c) {
+                    resampled.setColor(image.getColor(x * fx, y * fy, c), x, y, c);
+                }
+            }
+        }
+        return resampled;
+    };
+
+    for (int threads : { 1, 4 }) {
+        sift::setThreadCount(threads);
+        for (int channels = 1; channels <= 4; ++channels) {
+            const sift::Image image = createRampImage(203, 149, channels, 0.5f);
+            for (int factor = 1; factor <= 3; ++factor) {
+                const sift::Image expected = resampleReference(image, factor, factor);
+                CHECK(sift::resampleImage(image, factor, factor) == expected);
+                CHECK(sift::resampleImage(sift::convertPixelLayout(image, sift::PixelLayout::Planar), factor, factor) ==
+                      expected);
+            }
+            CHECK(sift::resampleImage(image, 2, 3) == resampleReference(image, 2, 3));
+
+            // Views with other strides than the image, here one channel of it and a crop, are
+            // decimated element by element.
+            sift::Image channel(101, 74, 1);
+            sift::decimateImageView(image.getView().getChannel(channels - 1), channel.getView(), 2, 2);
+            const sift::Image expectedChannel = resampleReference(sift::Image(image.getView().getChannel(channels - 1)),
+                                                                  2, 2);
+            CHECK(channel == expectedChannel);
+
+            sift::Image crop(50, 40, channels, sift::RowPadding::CacheLine);
+            sift::decimateImageView(image.getView().crop(3, 5, 100, 80), crop.getView(), 2, 2);
+            CHECK(crop == resampleReference(sift::Image(image.getView().crop(3, 5, 100, 80)), 2, 2));
+        }
+
+        // The pixels of other types are copied as they are.
+        const sift::Image8 image8 = sift::convertPixelType<uint8_t>(createRampImage(33, 21, 3, 0.0f));
+        const sift::Image8 resampled8 = sift::resampleImage(image8, 2, 2);
+        REQUIRE(resampled8.getWidth() == 16);
+        REQUIRE(resampled8.getHeight() == 10);
+        CHECK(resampled8.getColor(7, 9, 2) == image8.getColor(14, 18, 2));
+    }
+    sift::setThreadCount(0);
+
+    // Fractional factors still work and so does resampling an image into itself.
+    sift::Image image = createRampImage(20, 10, 2, 0.0f);
+    CHECK(sift::resampleImage(image, 1.5f, 2.5f).getColor(3, 2, 1) == image.getColor(4, 5, 1));
+    const sift::Image expected = resampleReference(image, 2, 2);
+    sift::resampleImageInPlace(&image, 2, 2);
+    CHECK(image == expected);
+}
+
+TEST_CASE("Image resampling modes", "[image]") {
+    const sift::Image image = createRampImage(61, 47, 3, 0.5f);
+
+    // Shrinking by 2 averages 2 x 2 blocks, with either filter.
+    for (sift::ResampleMode mode : { sift::ResampleMode::Area, sift::ResampleMode::Bilinear }) {
+        const sift::Image halved = sift::resampleImage(image, 2, 2, mode);
+        REQUIRE(halved.getWidth() == 30);
+        REQUIRE(halved.getHeight() == 23);
+        for (int y = 0; y < halved.getHeight(); ++y) {
+            for (int x = 0; x < halved.getWidth(); ++x) {
+                for (int c = 0; c < 3; ++c) {
+                    const float average = 0.25f * (image.getColor(2 * x, 2 * y, c) + image.getColor(2 * x + 1, 2 * y, c) +
+                                                   image.getColor(2 * x, 2 * y + 1, c) +
+                                                   image.getColor(2 * x + 1, 2 * y + 1, c));
+                    REQUIRE(halved.getColor(x, y, c) == Approx(average));
+                }
+            }
+        }
+    }
+
+    // A factor of 1 keeps the image.
+    CHECK(sift::resampleImage(image, 1, 1, sift::ResampleMode::Area) == image);
+    CHECK(sift::resampleImage(image, 1, 1, sift::ResampleMode::Bilinear) == image);
+
+    // Enlarging interpolates between the pixel centers and repeats the edges.
+    const sift::Image doubled = sift::resampleImage(image, 0.5f, 0.5f, sift::ResampleMode::Bilinear);
+    REQUIRE(doubled.getWidth() == 122);
+    CHECK(doubled.getColor(0, 0, 1) == Approx(image.getColor(0, 0, 1)));
+    CHECK(doubled.getColor(3, 0, 1) == Approx(0.75f * image.getColor(1, 0, 1) + 0.25f * image.getColor(2, 0, 1)));
+    CHECK(doubled.getColor(121, 93, 2) == Approx(image.getColor(60, 46, 2)));
+
+    // Every source pixel counts the same when shrinking by an area, so the mean is kept for any factor.
+    const auto mean = [](const sift::Image& image) {
+        double sum = 0.0;
+        for (int y = 0; y < image.getHeight(); ++y) {
+            for (int x = 0; x < image.getWidth(); ++x) {
+                sum += image.getColor(x, y, 0);
+            }
+        }
+        return sum / (static_cast<double>(image.getWidth()) * image.getHeight());
+    };
+    const sift::Image square = createRampImage(60, 60, 1, 0.0f);
+    CHECK(mean(sift::resampleImage(square, 2.5f, 7.5f, sift::ResampleMode::Area)) == Approx(mean(square)));
+    CHECK(mean(sift::resampleImage(square, 0.75f, 1.5f, sift::ResampleMode::Area)) == Approx(mean(square)).epsilon(0.01));
+
+    // Layouts, pixel types and thread counts do not change the result.
+    for (sift::ResampleMode mode : { sift::ResampleMode::Area, sift::ResampleMode::Bilinear }) {
+        sift::setThreadCount(1);
+        const sift::Image expected = sift::resampleImage(image, 2.7f, 1.3f, mode);
+        sift::setThreadCount(4);
+        CHECK(sift::resampleImage(image, 2.7f, 1.3f, mode) == expected);
+        CHECK(sift::resampleImage(sift::convertPixelLayout(image, sift::PixelLayout::Planar), 2.7f, 1.3f, mode) ==
+              expected);
+
+        const sift::Image8 image8 = sift::convertPixelType<uint8_t>(sift::Image(image * (1.0f / 2200.0f)));
+        const sift::Image8 resampled8 = sift::resampleImage(image8, 2.7f, 1.3f, mode);
+        const sift::Image expected8 = sift::resampleImage(sift::convertPixelType<float>(image8), 2.7f, 1.3f, mode);
+        REQUIRE(resampled8.getWidth() == expected8.getWidth());
+        for (int y = 0; y < resampled8.getHeight(); ++y) {
+            for (int x = 0; x < resampled8.getWidth(); ++x) {
+                REQUIRE(resampled8.getColor(x, y, 2) == sift::PixelTraits<uint8_t>::fromFloat(expected8.getColor(x, y, 2)));
+            }
+        }
+    }
+    sift::setThreadCount(0);
+}
@@ -0,0 +1,189 @@
+// Copyright 2017 Michael Bao. All rights reserved.
+// Use of this source code is governed by a MIT license that can be
+// found in the LICENSE file. The SIFT algorithm is
+// patented and its use for commercial applications must be licensed.
+// See the LICENSE file for details.
+
+#define CATCH_CONFIG_MAIN 
+#include "catch.hpp"
+#include "cpu_features.h"
+#include "kernels.h"
+#include "parallel.h"
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+
+std::vector<float> createRandomArray(size_t size, unsigned int seed)
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    std::vector<float> values(size);
+    for (float& value : values) {
+        value = distribution(generator);
+    }
+    return values;
+}
+
+void checkArraysClose(const std::vector<float>& actual, const std::vector<float>& expected)
+{
+    REQUIRE(actual.size() == expected.size());
+    for (size_t i = 0; i < actual.size(); ++i) {
+        REQUIRE(actual[i] == Approx(expected[i]).margin(1e-5));
+    }
+}
+
+}
+
+TEST_CASE("Instruction set names", "[kernels]") {
+    sift::InstructionSet instructionSet;
+    REQUIRE(sift::parseInstructionSet("scalar", &instructionSet));
+    CHECK(instructionSet == sift::InstructionSet::Scalar);
+    REQUIRE(sift::parseInstructionSet("SSE2", &instructionSet));
+    CHECK(instructionSet == sift::InstructionSet::SSE2);
+    REQUIRE(sift::parseInstructionSet("avx2", &instructionSet));
+    CHECK(instructionSet == sift::InstructionSet::AVX2);
+    CHECK_FALSE(sift::parseInstructionSet("avx", &instructionSet));
+    CHECK_FALSE(sift::parseInstructionSet("avx512", &instructionSet));
+    CHECK_FALSE(sift::parseInstructionSet("", &instructionSet));
+
+    CHECK(static_cast<int>(sift::getActiveInstructionSet()) <= static_cast<int>(sift::getSupportedInstructionSet()));
+    CHECK(sift::detail::getKernels().instructionSet == sift::getActiveInstructionSet());
+}
+
+TEST_CASE("Kernels match for every instruction set", "[kernels]") {
+    const sift::detail::KernelTable* scalar = sift::detail::getKernels(sift::InstructionSet::Scalar);
+    REQUIRE(scalar != nullptr);
+
+    // Odd sizes exercise both vector widths and the scalar tails.
+    const size_t count = 77;
+    const int radius = 5;
+    const std::vector<float> x = createRandomArray(count + 2 * radius, 1);
+    const std::vector<float> y = createRandomArray(count, 2);
+    const std::vector<float> z = createRandomArray(count, 3);
+    const std::vector<float> w = createRandomArray(count, 4);
+    const float taps[radius + 1] = { 0.3f, 0.2f, 0.1f, 0.05f, 0.025f, 0.0125f };
+    const float coefficients[4] = { 0.2f, 1.1f, -0.5f, 0.2f };
+    const float* inputs[2 * radius + 1];
+    for (int k = 0; k <= 2 * radius; ++k) {
+        inputs[k] = x.data() + k;
+    }
+
+    const sift::InstructionSet instructionSets[] = { sift::InstructionSet::SSE2, sift::InstructionSet::AVX2 };
+    for (sift::InstructionSet instructionSet : instructionSets) {
+        const sift::detail::KernelTable* kernels = sift::detail::getKernels(instructionSet);
+        if (kernels == nullptr) {
+            WARN("Skipping " << sift::getInstructionSetName(instructionSet) << ", it is not supported.");
+            continue;
+        }
+        CHECK(kernels->instructionSet == instructionSet);
+
+        std::vector<float> expected(count);
+        std::vector<float> expectedDifference(count);
+        std::vector<float> actual(count);
+        std::vector<float> actualDifference(count);
+
+        scalar->convolveSpan(inputs, expected.data(), count, taps, radius);
+        kernels->convolveSpan(inputs, actual.data(), count, taps, radius);
+        checkArraysClose(actual, expected);
+
+        scalar->convolveSpanAndSubtract(inputs, expected.data(), y.data(), expectedDifference.data(),
+                                        count, taps, radius);
+        kernels->convolveSpanAndSubtract(inputs, actual.data(), y.data(), actualDifference.data(),
+                                         count, taps, radius);
+        checkArraysClose(actual, expected);
+        checkArraysClose(actualDifference, expectedDifference);
+
+        scalar->recursiveFilterSpan(y.data(), z.data(), w.data(), x.data(), expected.data(), count, coefficients);
+        kernels->recursiveFilterSpan(y.data(), z.data(), w.data(), x.data(), actual.data(), count, coefficients);
+        checkArraysClose(actual, expected);
+
+        scalar->add(y.data(), z.data(), expected.data(), count);
+        kernels->add(y.data(), z.data(), actual.data(), count);
+        checkArraysClose(actual, expected);
+
+        scalar->subtract(y.data(), z.data(), expected.data(), count);
+        kernels->subtract(y.data(), z.data(), actual.data(), count);
+        checkArraysClose(actual, expected);
+
+        scalar->negate(y.data(), expected.data(), count);
+        kernels->negate(y.data(), actual.data(), count);
+        checkArraysClose(actual, expected);
+
+        scalar->scale(0.75f, y.data(), expected.data(), count);
+        kernels->scale(0.75f, y.data(), actual.data(), count);
+        checkArraysClose(actual, expected);
+
+        scalar->axpby(0.75f, y.data(), -2.0f, z.data(), expected.data(), count);
+        kernels->axpby(0.75f, y.data(), -2.0f, z.data(), actual.data(), count);
+        checkArraysClose(actual, expected);
+
+        CHECK(kernels->equal(y.data(), y.data(), count));
+        CHECK_FALSE(kernels->equal(y.data(), z.data(), count));
+
+        // Three taps per output with the inputs of neighboring outputs overlapping like in a resize.
+        std::vector<int> offsets(count);
+        std::vector<float> weights(3 * count);
+        for (size_t i = 0; i < count; ++i) {
+            offsets[i] = static_cast<int>(i / 2);
+            weights[i] = z[i];
+            weights[count + i] = w[i];
+            weights[2 * count + i] = y[i];
+        }
+        scalar->resampleSpan(x.data(), offsets.data(), weights.data(), 3, 2, expected.data(), count);
+        kernels->resampleSpan(x.data(), offsets.data(), weights.data(), 3, 2, actual.data(), count);
+        checkArraysClose(actual, expected);
+        CHECK(expected[5] == Approx(z[5] * x[2] + w[5] * x[4] + y[5] * x[6]));
+
+        scalar->weightedSumSpan(inputs, taps, radius + 1, expected.data(), count);
+        kernels->weightedSumSpan(inputs, taps, radius + 1, actual.data(), count);
+        checkArraysClose(actual, expected);
+
+        for (int channels = 1; channels <= 4; ++channels) {
+            const size_t pixels = x.size() / (2 * channels);
+            std::vector<float> expectedPixels(pixels * channels);
+            std::vector<float> actualPixels(pixels * channels);
+            scalar->decimateSpan(x.data(), expectedPixels.data(), pixels, channels);
+            kernels->decimateSpan(x.data(), actualPixels.data(), pixels, channels);
+            CHECK(actualPixels == expectedPixels);
+            CHECK(expectedPixels[channels] == x[2 * channels]);
+        }
+    }
+}
+
+TEST_CASE("Parallel loops", "[kernels]") {
+    const int threadCount = sift::getThreadCount();
+    CHECK(threadCount >= 1);
+
+    for (int threads : { 1, 3, 8 }) {
+        sift::setThreadCount(threads);
+        CHECK(sift::getThreadCount() == threads);
+
+        // Every index is visited exactly once. Catch is not thread-safe so nothing is checked
+        // inside the loops.
+        std::vector<int> visits(101);
+        sift::detail::parallelFor(-1, 100, 7, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                ++visits[i + 1];
+            }
+        });
+        CHECK(std::count(visits.begin(), visits.end(), 1) == 101);
+
+        bool called = false;
+        sift::detail::parallelFor(5, 5, 1, [&](int, int) { called = true; });
+        CHECK_FALSE(called);
+
+        // The exception of the last chunk reaches the caller after all other chunks are done.
+        CHECK_THROWS_AS(sift::detail::parallelFor(0, 100, 1, [](int, int end) {
+            if (end == 100) {
+                throw std::runtime_error("Chunk failed.");
+            }
+        }), std::runtime_error);
+    }
+
+    sift::setThreadCount(0);
+    CHECK(sift::getThreadCount() == threadCount);
+}